@@ -2,11 +2,16 @@ CEXAMPLE_MOD_DIR := $(USERMOD_DIR)
 
 # Add all C files to SRC_USERMOD.
 SRC_USERMOD += $(CEXAMPLE_MOD_DIR)/modmcufont.c
+SRC_USERMOD += $(CEXAMPLE_MOD_DIR)/mcufont/decoder/mf_band.c
 SRC_USERMOD += $(CEXAMPLE_MOD_DIR)/mcufont/decoder/mf_bwfont.c
 SRC_USERMOD += $(CEXAMPLE_MOD_DIR)/mcufont/decoder/mf_encoding.c
 SRC_USERMOD += $(CEXAMPLE_MOD_DIR)/mcufont/decoder/mf_font.c
+SRC_USERMOD += $(CEXAMPLE_MOD_DIR)/mcufont/decoder/mf_framebuffer.c
+SRC_USERMOD += $(CEXAMPLE_MOD_DIR)/mcufont/decoder/mf_glyphcache.c
+SRC_USERMOD += $(CEXAMPLE_MOD_DIR)/mcufont/decoder/mf_grayfont.c
 SRC_USERMOD += $(CEXAMPLE_MOD_DIR)/mcufont/decoder/mf_justify.c
 SRC_USERMOD += $(CEXAMPLE_MOD_DIR)/mcufont/decoder/mf_kerning.c
+SRC_USERMOD += $(CEXAMPLE_MOD_DIR)/mcufont/decoder/mf_ramfont.c
 SRC_USERMOD += $(CEXAMPLE_MOD_DIR)/mcufont/decoder/mf_rlefont.c
 SRC_USERMOD += $(CEXAMPLE_MOD_DIR)/mcufont/decoder/mf_scaledfont.c
 SRC_USERMOD += $(CEXAMPLE_MOD_DIR)/mcufont/decoder/mf_wordwrap.c
@@ -4,9 +4,14 @@
 #define _MCUFONT_H_
 
 #include "mf_config.h"
+#include "mf_band.h"
 #include "mf_encoding.h"
+#include "mf_framebuffer.h"
+#include "mf_glyphcache.h"
+#include "mf_grayfont.h"
 #include "mf_justify.h"
 #include "mf_kerning.h"
+#include "mf_ramfont.h"
 #include "mf_rlefont.h"
 #include "mf_scaledfont.h"
 #include "mf_wordwrap.h"
@@ -9,10 +9,15 @@ MFINC = $(MFDIR)
 
 # Source code files to include
 MFSRC = \
+    $(MFDIR)/mf_band.c \
     $(MFDIR)/mf_encoding.c \
     $(MFDIR)/mf_font.c \
+    $(MFDIR)/mf_framebuffer.c \
+    $(MFDIR)/mf_glyphcache.c \
+    $(MFDIR)/mf_grayfont.c \
     $(MFDIR)/mf_justify.c \
     $(MFDIR)/mf_kerning.c \
+    $(MFDIR)/mf_ramfont.c \
     $(MFDIR)/mf_rlefont.c \
     $(MFDIR)/mf_bwfont.c \
     $(MFDIR)/mf_scaledfont.c \
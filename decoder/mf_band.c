@@ -0,0 +1,78 @@
+#include "mf_band.h"
+
+void mf_band_init(struct mf_band_layout_s *layout,
+                  const struct mf_font_s *font,
+                  struct mf_band_glyph_s *glyphs,
+                  uint16_t capacity)
+{
+    layout->font = font;
+    layout->glyphs = glyphs;
+    layout->capacity = capacity;
+    layout->count = 0;
+}
+
+uint8_t mf_band_add_character(int16_t x0, int16_t y0,
+                              mf_char character, void *state)
+{
+    struct mf_band_layout_s *layout = state;
+    const struct mf_font_s *font = layout->font;
+    struct mf_band_glyph_s *glyph;
+    uint8_t width;
+
+    width = font->character_width(font, character);
+    if (!width)
+    {
+        character = font->fallback_character;
+        width = font->character_width(font, character);
+    }
+
+    if (layout->count < layout->capacity)
+    {
+        glyph = &layout->glyphs[layout->count++];
+        glyph->x = x0;
+        glyph->y = y0;
+        glyph->character = character;
+        glyph->resume.offset = 0;
+        glyph->resume.pixel = 0;
+    }
+
+    return width;
+}
+
+void mf_band_render(struct mf_band_layout_s *layout,
+                    int16_t y0, int16_t y1,
+                    mf_pixel_callback_t callback,
+                    void *state)
+{
+    const struct mf_font_s *font = layout->font;
+    struct mf_band_glyph_s *glyph, *end;
+    struct mf_rect_s clip;
+    int16_t y;
+
+    clip.x0 = INT16_MIN;
+    clip.y0 = 0;
+    clip.x1 = INT16_MAX;
+    clip.y1 = y1 - y0;
+
+    end = layout->glyphs + layout->count;
+    for (glyph = layout->glyphs; glyph < end; glyph++)
+    {
+        y = glyph->y - y0;
+        if (y >= clip.y1 || y + font->height <= 0)
+            continue;
+
+        /* Only the characters split between bands need to remember where
+         * they stopped. The others can use the glyph cache through the
+         * normal clipped rendering. */
+        if (font->render_rows && (y < 0 || y + font->height > clip.y1))
+        {
+            font->render_rows(font, glyph->x, y, glyph->character,
+                              0, clip.y1, &glyph->resume, callback, state);
+        }
+        else
+        {
+            mf_render_character_clipped(font, glyph->x, y, glyph->character,
+                                        &clip, callback, state);
+        }
+    }
+}
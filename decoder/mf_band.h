@@ -0,0 +1,78 @@
+/* Rendering text a band of rows at a time. Displays that are too large for
+ * a framebuffer in RAM can be drawn in horizontal bands, e.g. 16 rows at a
+ * time, with a buffer for only one band. The text is laid out once into a
+ * list of glyph positions, and each band then decodes only the glyphs that
+ * overlap it. Fonts that support it continue decoding each glyph where the
+ * previous band stopped, so that the glyph data is read about once for the
+ * whole display.
+ */
+
+#ifndef _MF_BAND_H_
+#define _MF_BAND_H_
+
+#include "mf_font.h"
+
+/* A character placed in the layout, see mf_band_layout_s. */
+struct mf_band_glyph_s
+{
+    /* Upper left corner of the character. */
+    int16_t x;
+    int16_t y;
+
+    /* The character to render. Missing characters are replaced with the
+     * fallback character when they are added. */
+    mf_char character;
+
+    /* Where the rendering continues in the next band. */
+    struct mf_resume_s resume;
+};
+
+/* Positions of the characters to render, stored in memory given by the
+ * caller. */
+struct mf_band_layout_s
+{
+    const struct mf_font_s *font;
+    struct mf_band_glyph_s *glyphs;
+    uint16_t capacity;
+    uint16_t count;
+};
+
+/* Start a new, empty layout.
+ *
+ * layout:   Layout to initialize.
+ * font:     Font to render the characters with.
+ * glyphs:   Array to store the character positions in.
+ * capacity: Number of items in glyphs.
+ */
+MF_EXTERN void mf_band_init(struct mf_band_layout_s *layout,
+                            const struct mf_font_s *font,
+                            struct mf_band_glyph_s *glyphs,
+                            uint16_t capacity);
+
+/* Character callback that adds the character to the layout instead of
+ * rendering it. Pass this with the layout as state to e.g.
+ * mf_render_justified() to lay out the text. Characters that do not fit
+ * in the layout are left out.
+ *
+ * Returns the width of the character.
+ */
+MF_EXTERN uint8_t mf_band_add_character(int16_t x0, int16_t y0,
+                                        mf_char character, void *state);
+
+/* Render the rows from y0 up to, but not including, y1 of the layout.
+ * The y coordinates passed to the callback are relative to y0, so that it
+ * can write directly to a buffer that holds only the band. The bands
+ * should be rendered from top to bottom for the decoding to continue from
+ * one band to the next; other orders also work, only slower.
+ *
+ * layout:   Layout to render.
+ * y0, y1:   Rows of the band.
+ * callback: Callback function to write out the pixels.
+ * state:    Free variable for caller to use (can be NULL).
+ */
+MF_EXTERN void mf_band_render(struct mf_band_layout_s *layout,
+                              int16_t y0, int16_t y1,
+                              mf_pixel_callback_t callback,
+                              void *state);
+
+#endif
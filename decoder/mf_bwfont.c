@@ -1,19 +1,43 @@
 #include "mf_bwfont.h"
 #include <stdbool.h>
 
-/* Find the character range and index that contains a given glyph.. */
+/* Find the character range and index that contains a given glyph.
+ * Uses the range map if the font has one, otherwise a binary search. */
 static const struct mf_bwfont_char_range_s *find_char_range(
     const struct mf_bwfont_s *font, uint16_t character, uint16_t *index_ret)
 {
-    unsigned i, index;
+    unsigned low, high, mid;
     const struct mf_bwfont_char_range_s *range;
-    for (i = 0; i < font->char_range_count; i++)
+
+    if (font->range_map && character < MF_RANGE_MAP_SIZE)
+    {
+        mid = pgm_read_byte(font->range_map + character);
+        if (mid >= font->char_range_count)
+            return 0;
+
+        range = &font->char_ranges[mid];
+        *index_ret = character - range->first_char;
+        return range;
+    }
+
+    low = 0;
+    high = font->char_range_count;
+    while (low < high)
     {
-        range = &font->char_ranges[i];
-        index = character - range->first_char;
-        if (character >= range->first_char && index < range->char_count)
+        mid = (low + high) / 2;
+        range = &font->char_ranges[mid];
+
+        if (character < range->first_char)
         {
-            *index_ret = index;
+            high = mid;
+        }
+        else if (character - range->first_char >= range->char_count)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            *index_ret = character - range->first_char;
             return range;
         }
     }
@@ -33,10 +57,101 @@ static uint8_t get_width(const struct mf_bwfont_char_range_s *r, uint16_t index)
     }
 }
 
+/* Find the data of a glyph. The size of the glyph is stored to size: the
+ * number of columns, or the number of bytes in each row if the range is
+ * row major. */
+static const uint8_t *get_glyph_data(const struct mf_bwfont_char_range_s *r,
+                                     uint16_t index, uint8_t *size)
+{
+    uint8_t unit = r->row_major ? r->height_pixels : r->height_bytes;
+
+    if (r->width)
+    {
+        *size = r->row_major ? (r->width + 7) / 8 : r->width;
+        return r->glyph_data + (uint32_t)*size * index * unit;
+    }
+    else
+    {
+        *size = r->glyph_offsets[index + 1] - r->glyph_offsets[index];
+        return r->glyph_data + (uint32_t)r->glyph_offsets[index] * unit;
+    }
+}
+
+/* Number of leading zero bits in a nonzero byte. */
+static uint8_t leading_zeros(uint8_t byte)
+{
+#if defined(__GNUC__)
+    return __builtin_clz(byte) - (sizeof(unsigned) * 8 - 8);
+#else
+    uint8_t count = 0;
+    while (!(byte & 0x80))
+    {
+        byte <<= 1;
+        count++;
+    }
+    return count;
+#endif
+}
+
+/* Pass a run of pixels to the framebuffer if there is one, otherwise to
+ * the callback. */
+static void write_run(int16_t x, int16_t y, uint8_t count,
+                      mf_pixel_callback_t callback, void *state,
+                      const struct mf_framebuffer_s *fb)
+{
+    if (fb)
+        mf_framebuffer_write_run(fb, x, y, count, 255);
+    else
+        callback(x, y, count, 255, state);
+}
+
+/* Render a row of a row major glyph. The edges of the runs are found a
+ * byte at a time by counting the leading bits that are the same. */
+static void render_packed_row(const uint8_t *p, uint8_t row_bytes,
+                              int16_t x0, int16_t y,
+                              mf_pixel_callback_t callback,
+                              void *state,
+                              const struct mf_framebuffer_s *fb)
+{
+    uint8_t i, byte, rest, bit;
+    int16_t x, start;
+    bool inside;
+
+    inside = false;
+    start = 0;
+    for (i = 0, x = 0; i < row_bytes; i++, x += 8)
+    {
+        byte = pgm_read_byte(p + i);
+        bit = 0;
+
+        for (;;)
+        {
+            rest = (inside ? ~byte : byte) & (0xFF >> bit);
+            if (!rest)
+                break;
+
+            bit = leading_zeros(rest);
+            if (inside)
+                write_run(x0 + start, y, x + bit - start, callback, state, fb);
+            else
+                start = x + bit;
+
+            inside = !inside;
+        }
+    }
+
+    if (inside)
+        write_run(x0 + start, y, x - start, callback, state, fb);
+}
+
+/* Render the rows from clip_y0 to clip_y1 of a glyph, to the framebuffer
+ * if fb is not NULL and otherwise to the callback. */
 static uint8_t render_char(const struct mf_bwfont_char_range_s *r,
                            int16_t x0, int16_t y0, uint16_t index,
+                           int16_t clip_y0, int16_t clip_y1,
                            mf_pixel_callback_t callback,
-                           void *state)
+                           void *state,
+                           const struct mf_framebuffer_s *fb)
 {
     const uint8_t *data, *p;
     uint8_t stride, runlen;
@@ -44,25 +159,35 @@ static uint8_t render_char(const struct mf_bwfont_char_range_s *r,
     uint8_t bit, byte, mask;
     bool oldstate, newstate;
 
-    if (r->width)
-    {
-        data = r->glyph_data + r->width * index * r->height_bytes;
-        num_cols = r->width;
-    }
-    else
-    {
-        data = r->glyph_data + r->glyph_offsets[index] * r->height_bytes;
-        num_cols = r->glyph_offsets[index + 1] - r->glyph_offsets[index];
-    }
+    data = get_glyph_data(r, index, &num_cols);
 
     stride = r->height_bytes;
     height = r->height_pixels;
     y0 += r->offset_y;
     x0 += r->offset_x;
-    bit = 0;
-    byte = 0;
 
-    for (y = 0; y < height; y++)
+    /* The rows are independent, so the clipped ones are simply skipped. */
+    y = 0;
+    if (clip_y0 > y0)
+        y = (clip_y0 - y0 < height) ? clip_y0 - y0 : height;
+    if (clip_y1 - y0 < height)
+        height = (clip_y1 > y0) ? clip_y1 - y0 : 0;
+
+    if (r->row_major)
+    {
+        for (; y < height; y++)
+        {
+            render_packed_row(data + (uint16_t)y * num_cols, num_cols,
+                              x0, y0 + y, callback, state, fb);
+        }
+
+        return get_width(r, index);
+    }
+
+    bit = y & 7;
+    byte = y >> 3;
+
+    for (; y < height; y++)
     {
         mask = (1 << bit);
 
@@ -76,7 +201,8 @@ static uint8_t render_char(const struct mf_bwfont_char_range_s *r,
             {
                 if (oldstate && runlen)
                 {
-                    callback(x0 + x - runlen, y0 + y, runlen, 255, state);
+                    write_run(x0 + x - runlen, y0 + y, runlen,
+                              callback, state, fb);
                 }
 
                 oldstate = newstate;
@@ -88,7 +214,7 @@ static uint8_t render_char(const struct mf_bwfont_char_range_s *r,
 
         if (oldstate && runlen)
         {
-            callback(x0 + x - runlen, y0 + y, runlen, 255, state);
+            write_run(x0 + x - runlen, y0 + y, runlen, callback, state, fb);
         }
 
         bit++;
@@ -116,7 +242,322 @@ uint8_t mf_bwfont_render_character(const struct mf_font_s *font,
     if (!range)
         return 0;
 
-    return render_char(range, x0, y0, index, callback, state);
+    return render_char(range, x0, y0, index, INT16_MIN, INT16_MAX,
+                       callback, state, 0);
+}
+
+uint8_t mf_bwfont_render_rows(const struct mf_font_s *font,
+                              int16_t x0, int16_t y0,
+                              uint16_t character,
+                              int16_t clip_y0, int16_t clip_y1,
+                              struct mf_resume_s *resume,
+                              mf_pixel_callback_t callback,
+                              void *state)
+{
+    const struct mf_bwfont_s *bwfont = (const struct mf_bwfont_s*)font;
+    const struct mf_bwfont_char_range_s *range;
+    uint16_t index;
+
+    /* Any row can be found directly, there is nothing to resume. */
+    (void)resume;
+
+    range = find_char_range(bwfont, character, &index);
+    if (!range)
+        return 0;
+
+    return render_char(range, x0, y0, index, clip_y0, clip_y1,
+                       callback, state, 0);
+}
+
+/* Collect the bytes of each row of a row major glyph into word masks. A
+ * byte can be split between two words if the masks are not byte aligned. */
+static void render_packed_masks(const uint8_t *data, uint8_t row_bytes,
+                                uint8_t height, int16_t x0, int16_t y0,
+                                uint8_t align, mf_mask_callback_t callback,
+                                void *state)
+{
+    int16_t first, x_base, offset;
+    uint8_t y, i, byte;
+    uint32_t mask;
+
+    first = x0 - (uint16_t)x0 % align;
+
+    for (y = 0; y < height; y++, data += row_bytes)
+    {
+        mask = 0;
+        x_base = first;
+        offset = x0 - first;
+
+        for (i = 0; i < row_bytes; i++, offset += 8)
+        {
+            byte = pgm_read_byte(data + i);
+
+            if (offset >= 32)
+            {
+                if (mask)
+                    callback(x_base, y0 + y, mask, state);
+
+                mask = 0;
+                x_base += 32;
+                offset -= 32;
+            }
+
+            mask |= ((uint32_t)byte << 24) >> offset;
+
+            if (offset > 24)
+            {
+                if (mask)
+                    callback(x_base, y0 + y, mask, state);
+
+                mask = (uint32_t)byte << (56 - offset);
+                x_base += 32;
+                offset -= 32;
+            }
+        }
+
+        if (mask)
+            callback(x_base, y0 + y, mask, state);
+    }
+}
+
+uint8_t mf_bwfont_render_masks(const struct mf_font_s *font,
+                               int16_t x0, int16_t y0,
+                               uint16_t character,
+                               uint8_t align,
+                               mf_mask_callback_t callback,
+                               void *state)
+{
+    const struct mf_bwfont_s *bwfont = (const struct mf_bwfont_s*)font;
+    const struct mf_bwfont_char_range_s *range;
+    const uint8_t *data, *p;
+    uint16_t index;
+    uint8_t stride, num_cols, shift, rows, byte, b, k;
+    int16_t x_base, x, col, col_end;
+    uint32_t masks[8], bit;
+
+    range = find_char_range(bwfont, character, &index);
+    if (!range)
+        return 0;
+
+    data = get_glyph_data(range, index, &num_cols);
+    stride = range->height_bytes;
+    x0 += range->offset_x;
+    y0 += range->offset_y;
+
+    if (range->row_major)
+    {
+        render_packed_masks(data, num_cols, range->height_pixels, x0, y0,
+                            align, callback, state);
+        return get_width(range, index);
+    }
+
+    x_base = x0 - (uint16_t)x0 % align;
+    shift = x0 - x_base;
+
+    /* Each byte of the columns has 8 rows. The bits are collected into the
+     * masks of those rows a word at a time. */
+    for (b = 0; b < stride; b++)
+    {
+        rows = range->height_pixels - b * 8;
+        if (rows > 8)
+            rows = 8;
+
+        for (col = -shift; col < num_cols; col += 32)
+        {
+            col_end = (col + 32 < num_cols) ? col + 32 : num_cols;
+
+            for (k = 0; k < 8; k++)
+                masks[k] = 0;
+
+            x = (col < 0) ? 0 : col;
+            bit = 0x80000000UL >> (x - col);
+            p = data + b + x * stride;
+            for (; x < col_end; x++, bit >>= 1, p += stride)
+            {
+                byte = pgm_read_byte(p);
+                for (k = 0; byte; k++, byte >>= 1)
+                {
+                    if (byte & 1)
+                        masks[k] |= bit;
+                }
+            }
+
+            for (k = 0; k < rows; k++)
+            {
+                if (masks[k])
+                    callback(x0 + col, y0 + b * 8 + k, masks[k], state);
+            }
+        }
+    }
+
+    return get_width(range, index);
+}
+
+/* Get the bits of a page that are inside the clip rows of the
+ * framebuffer. */
+static uint8_t page_clip_mask(const struct mf_framebuffer_s *fb, int16_t page)
+{
+    int16_t first = fb->clip_y0 - page * 8;
+    int16_t last = fb->clip_y1 - page * 8;
+
+    if (first < 0)
+        first = 0;
+    if (last > 8)
+        last = 8;
+    if (last <= first)
+        return 0;
+
+    return (0xFF << first) & (0xFF >> (8 - last));
+}
+
+uint8_t mf_bwfont_render_pages(const struct mf_font_s *font,
+                               int16_t x0, int16_t y0,
+                               uint16_t character,
+                               const struct mf_framebuffer_s *fb)
+{
+    const struct mf_bwfont_s *bwfont = (const struct mf_bwfont_s*)font;
+    const struct mf_bwfont_char_range_s *range;
+    const uint8_t *data, *p;
+    uint8_t *dest;
+    uint16_t index;
+    uint8_t stride, num_cols, shift, mask, bits, b;
+    int16_t top, page, x, x_begin, x_end;
+
+    range = find_char_range(bwfont, character, &index);
+    if (!range)
+        return 0;
+
+    /* Row major glyphs would have to be transposed, so they are rendered
+     * a run at a time instead. */
+    if (range->row_major)
+    {
+        return render_char(range, x0, y0, index, fb->clip_y0, fb->clip_y1,
+                           0, 0, fb);
+    }
+
+    data = get_glyph_data(range, index, &num_cols);
+    stride = range->height_bytes;
+    x0 += range->offset_x;
+    top = y0 + range->offset_y;
+
+    /* The glyph bytes are split between two pages, unless the top row of
+     * the glyph is at the top of a page. */
+    page = (top >= 0) ? top / 8 : -((7 - top) / 8);
+    shift = top - page * 8;
+
+    x_begin = (fb->clip_x0 > x0) ? fb->clip_x0 - x0 : 0;
+    x_end = (fb->clip_x1 - x0 < num_cols) ? fb->clip_x1 - x0 : num_cols;
+
+    for (b = 0; b < stride || (b == stride && shift); b++, page++)
+    {
+        mask = page_clip_mask(fb, page);
+        if (!mask)
+            continue;
+
+        dest = fb->pixels + (uint32_t)fb->stride * page + x0;
+        p = data + b + x_begin * stride;
+        for (x = x_begin; x < x_end; x++, p += stride)
+        {
+            bits = 0;
+            if (b < stride)
+                bits = pgm_read_byte(p) << shift;
+            if (b > 0 && shift)
+                bits |= pgm_read_byte(p - 1) >> (8 - shift);
+
+            bits &= mask;
+            if (fb->color)
+                dest[x] |= bits;
+            else
+                dest[x] &= ~bits;
+        }
+    }
+
+    return get_width(range, index);
+}
+
+/* Copy the rows of a row major glyph into a MF_PIXEL_FORMAT_1BPP
+ * framebuffer a byte at a time, shifting them when the glyph does not start
+ * on a byte boundary. */
+static void blit_rows(const struct mf_bwfont_char_range_s *r,
+                      int16_t x0, int16_t y0, uint16_t index,
+                      const struct mf_framebuffer_s *fb)
+{
+    const uint8_t *data, *p;
+    uint8_t *dest;
+    uint8_t row_bytes, shift, mask, bits, b;
+    int16_t col, first, last, y, height;
+
+    data = get_glyph_data(r, index, &row_bytes);
+    x0 += r->offset_x;
+    y0 += r->offset_y;
+    height = r->height_pixels;
+
+    y = 0;
+    if (fb->clip_y0 > y0)
+        y = (fb->clip_y0 - y0 < height) ? fb->clip_y0 - y0 : height;
+    if (fb->clip_y1 - y0 < height)
+        height = (fb->clip_y1 > y0) ? fb->clip_y1 - y0 : 0;
+
+    /* Byte column of the framebuffer where the glyph starts. */
+    col = (x0 >= 0) ? x0 / 8 : -((7 - x0) / 8);
+    shift = x0 - col * 8;
+
+    for (; y < height; y++)
+    {
+        p = data + (uint16_t)y * row_bytes;
+        dest = fb->pixels + (uint32_t)fb->stride * (y0 + y);
+
+        for (b = 0; b < row_bytes || (b == row_bytes && shift); b++)
+        {
+            /* Bits of the byte that are inside the clip columns. */
+            first = fb->clip_x0 - (col + b) * 8;
+            last = fb->clip_x1 - (col + b) * 8;
+            if (first < 0)
+                first = 0;
+            if (last > 8)
+                last = 8;
+            if (last <= first)
+                continue;
+
+            mask = (0xFF >> first) & ~(0xFF >> last);
+
+            bits = 0;
+            if (b < row_bytes)
+                bits = pgm_read_byte(p + b) >> shift;
+            if (b > 0 && shift)
+                bits |= pgm_read_byte(p + b - 1) << (8 - shift);
+
+            bits &= mask;
+            if (fb->color)
+                dest[col + b] |= bits;
+            else
+                dest[col + b] &= ~bits;
+        }
+    }
+}
+
+uint8_t mf_bwfont_render_framebuffer(const struct mf_font_s *font,
+                                     int16_t x0, int16_t y0,
+                                     uint16_t character,
+                                     const struct mf_framebuffer_s *fb)
+{
+    const struct mf_bwfont_s *bwfont = (const struct mf_bwfont_s*)font;
+    const struct mf_bwfont_char_range_s *range;
+    uint16_t index;
+
+    range = find_char_range(bwfont, character, &index);
+    if (!range)
+        return 0;
+
+    /* The rows of row major glyphs are already in the framebuffer format. */
+    if (range->row_major && fb->format == MF_PIXEL_FORMAT_1BPP)
+    {
+        blit_rows(range, x0, y0, index, fb);
+        return get_width(range, index);
+    }
+
+    return render_char(range, x0, y0, index, fb->clip_y0, fb->clip_y1,
+                       0, 0, fb);
 }
 
 uint8_t mf_bwfont_character_width(const struct mf_font_s *font,
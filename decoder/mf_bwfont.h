@@ -6,9 +6,12 @@
 #define _MF_BWFONT_H_
 
 #include "mf_font.h"
+#include "mf_framebuffer.h"
 
 /* Versions of the BW font format that are supported. */
 #define MF_BWFONT_VERSION_4_SUPPORTED 1
+#define MF_BWFONT_VERSION_5_SUPPORTED 1
+#define MF_BWFONT_VERSION_6_SUPPORTED 1
 
 /* Structure for a range of characters. */
 struct mf_bwfont_char_range_s
@@ -45,6 +48,13 @@ struct mf_bwfont_char_range_s
      * column. The LSB of the first byte is the top left pixel.
      */
     uint8_t *glyph_data;
+
+    /* Nonzero if the glyph data is row-by-row instead. Each row of a glyph
+     * is then packed in (columns + 7) / 8 bytes, and the MSB of the first
+     * byte is the top left pixel. The glyph offsets are multiplied by
+     * height_pixels to get the byte offset, and the difference of two
+     * offsets is the number of bytes in a row. Added in version 6. */
+    uint8_t row_major;
 };
 
 /* Structure for the font */
@@ -58,8 +68,12 @@ struct mf_bwfont_s
     /* Number of character ranges. */
     uint8_t char_range_count;
 
-    /* Array of the character ranges */
+    /* Array of the character ranges, sorted by first_char. */
     struct mf_bwfont_char_range_s *char_ranges;
+
+    /* Table of MF_RANGE_MAP_SIZE entries that maps the first characters
+     * directly to their character range, or NULL. Added in version 5. */
+    const uint8_t *range_map;
 };
 
 /* Internal functions, don't use these directly. */
@@ -72,4 +86,29 @@ MF_EXTERN uint8_t mf_bwfont_render_character(const struct mf_font_s *font,
 MF_EXTERN uint8_t mf_bwfont_character_width(const struct mf_font_s *font,
                                             mf_char character);
 
+MF_EXTERN uint8_t mf_bwfont_render_rows(const struct mf_font_s *font,
+                                        int16_t x0, int16_t y0,
+                                        mf_char character,
+                                        int16_t clip_y0, int16_t clip_y1,
+                                        struct mf_resume_s *resume,
+                                        mf_pixel_callback_t callback,
+                                        void *state);
+
+MF_EXTERN uint8_t mf_bwfont_render_masks(const struct mf_font_s *font,
+                                         int16_t x0, int16_t y0,
+                                         mf_char character,
+                                         uint8_t align,
+                                         mf_mask_callback_t callback,
+                                         void *state);
+
+MF_EXTERN uint8_t mf_bwfont_render_pages(const struct mf_font_s *font,
+                                         int16_t x0, int16_t y0,
+                                         mf_char character,
+                                         const struct mf_framebuffer_s *fb);
+
+MF_EXTERN uint8_t mf_bwfont_render_framebuffer(const struct mf_font_s *font,
+                                               int16_t x0, int16_t y0,
+                                               mf_char character,
+                                               const struct mf_framebuffer_s *fb);
+
 #endif
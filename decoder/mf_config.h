@@ -12,6 +12,7 @@
  #define PROGMEM
  #define pgm_read_byte(addr) (*(const unsigned char *)(addr))
  #define pgm_read_word(addr) (*(const uint16_t *)(addr))
+ #define pgm_read_dword(addr) (*(const uint32_t *)(addr))
 #endif /* __AVR__ */
 
 
@@ -122,6 +123,13 @@
 #define MF_USE_TABS 1
 #endif
 
+/* Enable or disable the lookup tables in the rlefont decoder.
+ * The tables take about 1 kB of flash, but make decoding the glyphs faster.
+ */
+#ifndef MF_USE_DECODE_TABLES
+#define MF_USE_DECODE_TABLES 1
+#endif
+
 /* Number of vertical zones to use when computing kerning.
  * Larger values give more accurate kerning, but are slower and use somewhat
  * more memory. There is no point to increase this beyond the height of the
@@ -131,6 +139,29 @@
 #define MF_KERNING_ZONES 16
 #endif
 
+/* Maximum number of pixel runs that mf_render_character_rows() collects
+ * before passing them to the callback. Each run takes 4 bytes of stack.
+ */
+#ifndef MF_ROW_SPANS_MAX
+#define MF_ROW_SPANS_MAX 32
+#endif
+
+/* Enable or disable the glyph cache.
+ * If enabled, recently rendered glyphs are stored in a buffer given with
+ * mf_glyphcache_init() and replayed without decoding the font data again.
+ * This costs some RAM, but speeds up drawing the same text repeatedly.
+ */
+#ifndef MF_USE_GLYPH_CACHE
+#define MF_USE_GLYPH_CACHE 0
+#endif
+
+/* Number of glyphs that fit in the glyph cache. The buffer given to the
+ * cache is divided evenly between them.
+ */
+#ifndef MF_GLYPH_CACHE_ENTRIES
+#define MF_GLYPH_CACHE_ENTRIES 64
+#endif
+
 
 
 /* Add extern "C" when used from C++. */
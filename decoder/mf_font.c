@@ -1,6 +1,10 @@
 #include "mf_font.h"
 #include "mf_bwfont.h"
+#ifndef MF_RLEFONT_INTERNALS
+#define MF_RLEFONT_INTERNALS
+#endif
 #include "mf_rlefont.h"
+#include "mf_glyphcache.h"
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,21 +17,262 @@
 #include MF_FONT_FILE_NAME
 /* Include fonts end here */
 
+/* Render a character, or the fallback character if it is not found. */
+static uint8_t render_character(const struct mf_font_s *font,
+                                int16_t x0, int16_t y0,
+                                mf_char character,
+                                mf_pixel_callback_t callback,
+                                void *state)
+{
+    uint8_t width;
+    width = font->render_character(font, x0, y0, character, callback, state);
+
+    if (!width)
+    {
+        width = font->render_character(font, x0, y0, font->fallback_character,
+                                       callback, state);
+    }
+
+    return width;
+}
+
 uint8_t mf_render_character(const struct mf_font_s *font,
                             int16_t x0, int16_t y0,
                             mf_char character,
                             mf_pixel_callback_t callback,
                             void *state)
 {
+#if MF_USE_GLYPH_CACHE
+    return mf_glyphcache_render(font, x0, y0, character, callback, state,
+                                render_character);
+#else
+    return render_character(font, x0, y0, character, callback, state);
+#endif
+}
+
+/* State for limiting the pixel runs to the clip rectangle. */
+struct clip_state_s
+{
+    const struct mf_rect_s *clip;
+    mf_pixel_callback_t callback;
+    void *state;
+};
+
+/* Pixel callback that passes on the part of the run inside the clip. */
+static void clip_pixel_callback(int16_t x, int16_t y, uint8_t count,
+                                uint8_t alpha, void *state)
+{
+    struct clip_state_s *s = state;
+    int16_t x1 = x + count;
+
+    if (y < s->clip->y0 || y >= s->clip->y1)
+        return;
+
+    if (x < s->clip->x0)
+        x = s->clip->x0;
+
+    if (x1 > s->clip->x1)
+        x1 = s->clip->x1;
+
+    if (x1 > x)
+        s->callback(x, y, x1 - x, alpha, s->state);
+}
+
+uint8_t mf_render_character_clipped(const struct mf_font_s *font,
+                                    int16_t x0, int16_t y0,
+                                    mf_char character,
+                                    const struct mf_rect_s *clip,
+                                    mf_pixel_callback_t callback,
+                                    void *state)
+{
+    struct clip_state_s cstate;
     uint8_t width;
-    width = font->render_character(font, x0, y0, character, callback, state);
+
+    /* Skip the characters that are entirely outside of the clip. */
+    if (x0 >= clip->x1 || x0 + font->width <= clip->x0 ||
+        y0 >= clip->y1 || y0 + font->height <= clip->y0)
+    {
+        return mf_character_width(font, character);
+    }
+
+    cstate.clip = clip;
+    cstate.callback = callback;
+    cstate.state = state;
+
+    /* Whole rows can go through the glyph cache; only the characters cut
+     * by the top or bottom edge need the rows rendered separately. */
+    if (!font->render_rows || (y0 >= clip->y0 && y0 + font->height <= clip->y1))
+    {
+        return mf_render_character(font, x0, y0, character,
+                                   clip_pixel_callback, &cstate);
+    }
+
+    width = font->render_rows(font, x0, y0, character, clip->y0, clip->y1,
+                              0, clip_pixel_callback, &cstate);
 
     if (!width)
     {
-        width = font->render_character(font, x0, y0, font->fallback_character,
+        width = font->render_rows(font, x0, y0, font->fallback_character,
+                                  clip->y0, clip->y1, 0, clip_pixel_callback,
+                                  &cstate);
+    }
+
+    return width;
+}
+
+/* State for collecting the pixel runs of a row. */
+struct row_state_s
+{
+    mf_row_callback_t callback;
+    void *state;
+    int16_t y;
+    uint8_t count;
+    struct mf_span_s spans[MF_ROW_SPANS_MAX];
+};
+
+/* Pass the collected runs to the row callback. */
+static void flush_row(struct row_state_s *s)
+{
+    if (s->count)
+    {
+        s->callback(s->y, s->spans, s->count, s->state);
+        s->count = 0;
+    }
+}
+
+/* Pixel callback that adds the run to the current row. The renderers
+ * produce the runs in order, so a change of y means a new row. */
+static void row_pixel_callback(int16_t x, int16_t y, uint8_t count,
+                               uint8_t alpha, void *state)
+{
+    struct row_state_s *s = state;
+
+    if (y != s->y || s->count == MF_ROW_SPANS_MAX)
+    {
+        flush_row(s);
+        s->y = y;
+    }
+
+    s->spans[s->count].x = x;
+    s->spans[s->count].count = count;
+    s->spans[s->count].alpha = alpha;
+    s->count++;
+}
+
+uint8_t mf_render_character_rows(const struct mf_font_s *font,
+                                 int16_t x0, int16_t y0,
+                                 mf_char character,
+                                 mf_row_callback_t callback,
+                                 void *state)
+{
+    struct row_state_s rstate;
+    uint8_t width;
+
+    rstate.callback = callback;
+    rstate.state = state;
+    rstate.y = y0;
+    rstate.count = 0;
+
+    width = mf_render_character(font, x0, y0, character,
+                                row_pixel_callback, &rstate);
+    flush_row(&rstate);
+
+    return width;
+}
+
+/* State for collecting the pixel runs of a row into a bit mask. */
+struct mask_state_s
+{
+    mf_mask_callback_t callback;
+    void *state;
+    uint8_t align;
+    int16_t x;
+    int16_t y;
+    uint32_t mask;
+};
+
+/* Pass the collected mask to the mask callback. */
+static void flush_mask(struct mask_state_s *s)
+{
+    if (s->mask)
+    {
+        s->callback(s->x, s->y, s->mask, s->state);
+        s->mask = 0;
+    }
+}
+
+/* Pixel callback that sets the bits of the run in the current mask. A new
+ * mask is started when the run is on another row or outside of the word. */
+static void mask_pixel_callback(int16_t x, int16_t y, uint8_t count,
+                                uint8_t alpha, void *state)
+{
+    struct mask_state_s *s = state;
+    uint8_t first, n;
+    uint32_t bits;
+
+    if (alpha < 128)
+        return;
+
+    while (count)
+    {
+        if (!s->mask || y != s->y || x < s->x || x >= s->x + 32)
+        {
+            flush_mask(s);
+            s->x = x - (uint16_t)x % s->align;
+            s->y = y;
+        }
+
+        first = x - s->x;
+        n = 32 - first;
+        if (n > count)
+            n = count;
+
+        bits = 0xFFFFFFFFUL >> first;
+        if (first + n < 32)
+            bits &= ~(0xFFFFFFFFUL >> (first + n));
+
+        s->mask |= bits;
+        x += n;
+        count -= n;
+    }
+}
+
+uint8_t mf_render_character_masks(const struct mf_font_s *font,
+                                  int16_t x0, int16_t y0,
+                                  mf_char character,
+                                  uint8_t align,
+                                  mf_mask_callback_t callback,
+                                  void *state)
+{
+    struct mask_state_s mstate;
+    uint8_t width;
+
+    /* The bwfont columns can be turned into masks without going through
+     * the pixel runs. */
+    if (font->render_character == &mf_bwfont_render_character)
+    {
+        width = mf_bwfont_render_masks(font, x0, y0, character, align,
                                        callback, state);
+
+        if (!width)
+        {
+            width = mf_bwfont_render_masks(font, x0, y0,
+                                           font->fallback_character,
+                                           align, callback, state);
+        }
+
+        return width;
     }
 
+    mstate.callback = callback;
+    mstate.state = state;
+    mstate.align = align;
+    mstate.mask = 0;
+
+    width = mf_render_character(font, x0, y0, character,
+                                mask_pixel_callback, &mstate);
+    flush_mask(&mstate);
+
     return width;
 }
 
@@ -65,12 +310,48 @@ static void whitespace_callback(int16_t x, int16_t y, uint8_t count,
     }
 }
 
+/* Find the precomputed ink bounding box of a glyph, or NULL if the font
+ * does not have one for the character. */
+static const uint8_t *find_ink_box(const struct mf_font_s *font,
+                                   mf_char character)
+{
+    const struct mf_ink_range_s *range;
+    uint16_t index;
+    uint8_t i;
+
+    /* Missing characters are rendered with the fallback character. */
+    if (!font->ink_boxes || !font->character_width(font, character))
+        return 0;
+
+    for (i = 0; i < font->ink_boxes->range_count; i++)
+    {
+        range = &font->ink_boxes->ranges[i];
+        index = character - range->first_char;
+        if (character >= range->first_char && index < range->char_count)
+            return range->boxes + (uint32_t)index * 4;
+    }
+
+    return 0;
+}
+
 MF_EXTERN void mf_character_whitespace(const struct mf_font_s *font,
                                        mf_char character,
                                        uint8_t *left, uint8_t *top,
                                        uint8_t *right, uint8_t *bottom)
 {
     struct whitespace_state state = {255, 255, 0, 0};
+    const uint8_t *box;
+
+    box = find_ink_box(font, character);
+    if (box)
+    {
+        if (left) *left = pgm_read_byte(box);
+        if (top) *top = pgm_read_byte(box + 1);
+        if (right) *right = pgm_read_byte(box + 2);
+        if (bottom) *bottom = pgm_read_byte(box + 3);
+        return;
+    }
+
     mf_render_character(font, 0, 0, character, whitespace_callback, &state);
 
     if (state.min_x == 255 && state.min_y == 255)
@@ -127,24 +408,241 @@ const struct mf_font_list_s *mf_get_font_list(void)
 
 // Note to self: the alpha value is actually 0-16, so you can draw an rle font by thresholding 128
 
+// Little endian fields of the .mff files, which need not be aligned.
+static uint16_t read_u16(const uint8_t *p)
+{
+    return p[0] | ((uint16_t)p[1] << 8);
+}
+
+static uint32_t read_u32(const uint8_t *p)
+{
+    return read_u16(p) | ((uint32_t)read_u16(p + 2) << 16);
+}
+
+// Check that count more bytes can be read at run.
+static bool has_bytes(uint32_t run, uint32_t count, uint32_t len)
+{
+    return run <= len && count <= len - run;
+}
+
+// Check that a table of count items at offs lies within the file. The
+// tables that are read in place with wider types must be aligned to 4 bytes.
+static bool has_table(uint32_t offs, uint32_t count, uint32_t item_size,
+                      uint32_t len, bool aligned)
+{
+    if(aligned && (offs & 3) != 0)
+        return false;
+
+    return offs <= len && count <= (len - offs) / item_size;
+}
+
+// Check that a table of u16 offsets does not decrease, so that the sizes
+// computed from consecutive entries do not wrap. Stores the last entry.
+static bool check_offsets(const uint8_t* table, uint32_t count, uint32_t* end)
+{
+    *end = 0;
+    for(uint32_t i = 0; i < count; i++)
+    {
+        uint16_t next = read_u16(table + 2 * i);
+        if(next < *end)
+            return false;
+        *end = next;
+    }
+
+    return true;
+}
+
+// Read a pascal string into a newly allocated, null terminated string.
+static char* read_string(const uint8_t* bulk, uint32_t* run, uint32_t len)
+{
+    char* str;
+    uint8_t slen;
+
+    if(!has_bytes(*run, 1, len) || !has_bytes(*run + 1, bulk[*run], len))
+        return NULL;
+
+    slen = bulk[(*run)++];
+    str = calloc(slen+2, sizeof(char));
+    if(str)
+        memcpy(str, bulk+*run, slen);
+
+    *run += slen;
+    return str;
+}
+
+static bool load_bwfont(struct mf_bwfont_s* builtbw, uint8_t* bulk,
+                        uint32_t run, uint32_t len)
+{
+    if(!has_bytes(run, 1, len))
+        return false;
+
+    builtbw->char_range_count = bulk[run++];
+
+    // We'll need to allocate the ranges separately.
+    builtbw->char_ranges = calloc(builtbw->char_range_count, sizeof(struct mf_bwfont_char_range_s));
+    if(builtbw->char_range_count && !builtbw->char_ranges)
+        return false;
+
+    // Ready aim fire
+    for(int r = 0; r < builtbw->char_range_count; r++)
+    {
+        struct mf_bwfont_char_range_s* range = &(builtbw->char_ranges[r]);
+        uint32_t widths, offsets, data, columns;
+
+        if(!has_bytes(run, 2 + 2 + 5 + 3 * 4, len))
+            return false;
+
+        // Little endian u16s.
+        range->first_char = read_u16(bulk+run); run += 2;
+        range->char_count = read_u16(bulk+run); run += 2;
+
+        range->offset_x = bulk[run++];
+        range->offset_y = bulk[run++];
+        range->height_bytes = bulk[run++];
+        range->height_pixels = bulk[run++];
+        range->width = bulk[run++];
+
+        // These next fields are stored as offsets into the byte array, so make the math work.
+        // Also pay attention to the nulls - fixed fonts don't need width information.
+        widths = read_u32(bulk+run); run += 4;
+        offsets = read_u32(bulk+run); run += 4;
+        data = read_u32(bulk+run); run += 4;
+
+        if(range->width)
+        {
+            columns = (uint32_t)range->char_count * range->width;
+        }
+        else
+        {
+            // The offsets have one more entry, the end of the last glyph.
+            if(!has_table(widths, range->char_count, 1, len, false) ||
+               !has_table(offsets, range->char_count + 1, 2, len, false) ||
+               !check_offsets(bulk+offsets, range->char_count + 1, &columns))
+                return false;
+
+            range->glyph_widths = bulk+widths;
+            range->glyph_offsets = (uint16_t*)(bulk+offsets);
+        }
+
+        if(range->height_bytes && !has_table(data, columns, range->height_bytes, len, false))
+            return false;
+
+        range->glyph_data = bulk+data;
+    }
+
+    return true;
+}
+
+static bool load_rlefont(struct mf_rlefont_s* builtrle, uint8_t* bulk,
+                         uint32_t run, uint32_t len)
+{
+    struct mf_rlefont_char_range_s* ranges;
+    uint32_t data, offs, end;
+
+    // The tables are used in place, only the ranges are allocated.
+    if(((uintptr_t)bulk & 3) != 0 || !has_bytes(run, 2 + 2 + 1 + 3 * 4 + 1, len))
+        return false;
+
+    builtrle->rle_entry_count = read_u16(bulk+run); run += 2;
+    builtrle->dict_entry_count = read_u16(bulk+run); run += 2;
+    builtrle->dict_code_count = bulk[run++];
+    if(builtrle->rle_entry_count > builtrle->dict_entry_count)
+        return false;
+
+    // The dictionary offsets end with the size of the dictionary data, and
+    // each entry must fit between its offset and the next one.
+    data = read_u32(bulk+run); run += 4;
+    offs = read_u32(bulk+run); run += 4;
+    if(!has_table(offs, builtrle->dict_entry_count + 1, 2, len, true) ||
+       !check_offsets(bulk+offs, builtrle->dict_entry_count + 1, &end) ||
+       !has_table(data, end, 1, len, false))
+        return false;
+
+    builtrle->dictionary_data = bulk+data;
+    builtrle->dictionary_offsets = (uint16_t*)(bulk+offs);
+
+    offs = read_u32(bulk+run); run += 4;
+    if(offs && !has_table(offs, MF_RANGE_MAP_SIZE, 1, len, false))
+        return false;
+
+    builtrle->range_map = offs ? bulk+offs : NULL;
+
+    builtrle->char_range_count = bulk[run++];
+    ranges = calloc(builtrle->char_range_count, sizeof(struct mf_rlefont_char_range_s));
+    builtrle->char_ranges = ranges;
+    if(builtrle->char_range_count && !ranges)
+        return false;
+
+    for(int r = 0; r < builtrle->char_range_count; r++)
+    {
+        struct mf_rlefont_char_range_s* range = &ranges[r];
+        uint32_t count, bases, base;
+
+        if(!has_bytes(run, 2 + 2 + 5 * 4 + 1, len))
+            return false;
+
+        range->first_char = read_u16(bulk+run); run += 2;
+        range->char_count = read_u16(bulk+run); run += 2;
+        count = range->char_count;
+
+        // Offsets into the byte array, zero for the optional tables
+        // that the font does not have.
+        offs = read_u32(bulk+run); run += 4;
+        data = read_u32(bulk+run); run += 4;
+        bases = read_u32(bulk+run); run += 4;
+        if(!has_table(offs, count, 2, len, true) ||
+           (bases && !has_table(bases, (count + MF_RLEFONT_OFFSET_BLOCK_SIZE - 1) / MF_RLEFONT_OFFSET_BLOCK_SIZE, 4, len, true)))
+            return false;
+
+        range->glyph_offsets = (uint16_t*)(bulk+offs);
+        range->glyph_data = bulk+data;
+        range->glyph_offset_bases = bases ? (uint32_t*)(bulk+bases) : NULL;
+
+        // The glyph data itself is a stream of codes, but at least each
+        // glyph must start inside the file.
+        for(uint32_t i = 0; i < count; i++)
+        {
+            base = bases ? read_u32(bulk + bases + 4 * (i / MF_RLEFONT_OFFSET_BLOCK_SIZE)) : 0;
+            if(base > len || !has_table(data, base + read_u16(bulk + offs + 2 * i) + 1, 1, len, false))
+                return false;
+        }
+
+        offs = read_u32(bulk+run); run += 4;
+        if(offs && !has_table(offs, count, 1, len, false))
+            return false;
+
+        range->glyph_widths = offs ? bulk+offs : NULL;
+
+        offs = read_u32(bulk+run); run += 4;
+        if(offs && !has_table(offs, count, 4, len, false))
+            return false;
+
+        range->glyph_boxes = offs ? bulk+offs : NULL;
+
+        range->row_checkpoint_interval = bulk[run++];
+    }
+
+    return true;
+}
+
 struct mf_font_s* mf_make_font(uint8_t* bulk, uint32_t len)
 {
     struct mf_font_s* built;
     uint32_t run = 4;
+    bool rle, loaded;
 
-    // Determine type and version.
-    if(strequals("ftbw", (char*)bulk))
-    //if(bulk[0] == 'f' && bulk[1] == 't' && bulk[2] == 'b' && bulk[3] == 'w')
+    // Determine type and version. The magic is not null terminated.
+    if(len >= 4 && memcmp("ftbw", bulk, 4) == 0)
     {
         // Black and white fonts get a flag.
         built = calloc(1, sizeof(struct mf_bwfont_s));
-        built->flags = MF_FONT_FLAG_BW;
+        rle = false;
     }
-    else if(strequals("ftrl", (char*)bulk))
-    //else if(bulk[0] == 'f' && bulk[1] == 't' && bulk[2] == 'r' && bulk[3] == 'l')
+    else if(len >= 4 && memcmp("ftrl", bulk, 4) == 0)
     {
         // Normal run-length encoded font.
         built = calloc(1, sizeof(struct mf_rlefont_s));
+        rle = true;
     }
     else
     {
@@ -152,10 +650,19 @@ struct mf_font_s* mf_make_font(uint8_t* bulk, uint32_t len)
         return NULL;
     }
 
+    if(!built || !has_bytes(run, 2 + 8 + 2, len))
+    {
+        free(built);
+        return NULL;
+    }
+
     uint8_t typecase_version = bulk[run++];
     uint8_t font_version = bulk[run++];
 
-    if(typecase_version != MF_TYPECASE_VERSION_SUPPORTED)
+    // Run-length encoded fonts only come in the versions with the same
+    // structure.
+    if(typecase_version != MF_TYPECASE_VERSION_SUPPORTED ||
+       (rle && font_version != 4 && font_version != 5))
     {
         free(built);
         return NULL;
@@ -172,64 +679,55 @@ struct mf_font_s* mf_make_font(uint8_t* bulk, uint32_t len)
     built->flags = bulk[run++];
 
     // Little endian u16.
-    built->fallback_character = *((uint16_t*)(bulk+run)); run += 2;
+    built->fallback_character = read_u16(bulk+run); run += 2;
 
     // Pascal strings too.
-    uint8_t slen = bulk[run++];
-    built->full_name = calloc(slen+2, sizeof(char));
-    memcpy(built->full_name, bulk+run, slen);
-    run += slen;
+    built->full_name = read_string(bulk, &run, len);
+    built->short_name = built->full_name ? read_string(bulk, &run, len) : NULL;
 
-    slen = bulk[run++];
-    built->short_name = calloc(slen+2, sizeof(char));
-    memcpy(built->short_name, bulk+run, slen);
-    run += slen;
-
-    // Time for details.
-    if(built->flags & MF_FONT_FLAG_BW)
+    // Time for details. Run-length encoded fonts can have the BW flag
+    // too, so go by the magic.
+    if(!built->short_name)
+    {
+        loaded = false;
+    }
+    else if(!rle)
     {
         // Black and white fonts don't have much going on.
         struct mf_bwfont_s* builtbw = (struct mf_bwfont_s*)built;
         builtbw->version = font_version;
-        builtbw->char_range_count = bulk[run++];
+        built->flags |= MF_FONT_FLAG_BW;
 
         // Sidebar: set the appropriate handler functions too.
         built->character_width =  &mf_bwfont_character_width;
         built->render_character = &mf_bwfont_render_character;
+        built->render_rows = &mf_bwfont_render_rows;
 
-        // We'll need to allocate the ranges separately.
-        builtbw->char_ranges = calloc(builtbw->char_range_count, sizeof(struct mf_bwfont_char_range_s));
-
-        // Ready aim fire
-        for(int r = 0; r < builtbw->char_range_count; r++)
-        {
-            struct mf_bwfont_char_range_s* range = &(builtbw->char_ranges[r]);
-            
-            // Little endian u16s.
-            range->first_char = *((uint16_t*)(bulk+run)); run += 2;
-            range->char_count = *((uint16_t*)(bulk+run)); run += 2;
-
-            range->offset_x = bulk[run++];
-            range->offset_y = bulk[run++];
-            range->height_bytes = bulk[run++];
-            range->height_pixels = bulk[run++];
-            range->width = bulk[run++];
-
-            // These next fields are stored as offsets into the byte array, so make the math work.
-            // Also pay attention to the nulls - fixed fonts don't need width information.
-            uint32_t offs = *((uint32_t*)(bulk+run)); run += 4;
-            range->glyph_widths = (range->width) ? NULL : (uint8_t*)(bulk+offs);
-
-            offs = *((uint32_t*)(bulk+run)); run += 4;
-            range->glyph_offsets = (range->width) ? NULL : (uint16_t*)(bulk+offs);
-
-            offs = *((uint32_t*)(bulk+run)); run += 4;
-            range->glyph_data = (uint8_t*)(bulk+offs);
-        }
+        loaded = load_bwfont(builtbw, bulk, run, len);
     }
     else
     {
-        //("panic! loading rle fonts is not implemented yet\n");
+        struct mf_rlefont_s* builtrle = (struct mf_rlefont_s*)built;
+        builtrle->version = font_version;
+
+        built->character_width = &mf_rlefont_character_width;
+        built->render_character = &mf_rlefont_render_character;
+        built->render_rows = &mf_rlefont_render_rows;
+
+        loaded = load_rlefont(builtrle, bulk, run, len);
+    }
+
+    // Anything that does not fit in the file is rejected as a whole.
+    if(!loaded)
+    {
+        if(rle)
+            free((void*)((struct mf_rlefont_s*)built)->char_ranges);
+        else
+            free(((struct mf_bwfont_s*)built)->char_ranges);
+
+        free(built->short_name);
+        free(built->full_name);
+        free(built);
         return NULL;
     }
 
@@ -239,13 +737,16 @@ struct mf_font_s* mf_make_font(uint8_t* bulk, uint32_t len)
 
 void mf_destroy_font(struct mf_font_s* target)
 {
-    if(target->flags & MF_FONT_FLAG_BW)
+    /* The cache may have glyphs that refer to the font. */
+    mf_glyphcache_clear();
+
+    if(target->render_character == &mf_bwfont_render_character)
     {
         free(((struct mf_bwfont_s*)(target))->char_ranges);
     }
-    else
+    else if(target->render_character == &mf_rlefont_render_character)
     {
-        // Not done with this yet.
+        free((void*)((struct mf_rlefont_s*)(target))->char_ranges);
     }
 
     free(target->short_name);
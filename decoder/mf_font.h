@@ -20,6 +20,122 @@
 typedef void (*mf_pixel_callback_t) (int16_t x, int16_t y, uint8_t count,
                                      uint8_t alpha, void *state);
 
+/* A run of pixels on a row, see mf_row_callback_t. */
+struct mf_span_s
+{
+    int16_t x;
+    uint8_t count;
+    uint8_t alpha;
+};
+
+/* Callback function that writes several runs of pixels on the same row.
+ *
+ * y:     Y coordinate of the row.
+ * spans: Runs of pixels on the row, from left to right.
+ * count: Number of items in spans.
+ * state: Free variable that was passed to mf_render_character_rows().
+ */
+typedef void (*mf_row_callback_t) (int16_t y, const struct mf_span_s *spans,
+                                   uint8_t count, void *state);
+
+/* Callback function that writes a part of a row of a black & white glyph
+ * as a bit mask.
+ *
+ * x:     X coordinate of the pixel in the most significant bit of mask.
+ * y:     Y coordinate of the row.
+ * mask:  Pixels of the row, one bit each. Bit 31 is the pixel at x, bit 30
+ *        the pixel at x + 1 and so on.
+ * state: Free variable that was passed to mf_render_character_masks().
+ */
+typedef void (*mf_mask_callback_t) (int16_t x, int16_t y, uint32_t mask,
+                                    void *state);
+
+/* Rectangle for limiting the area that is rendered to.
+ * The right and bottom edges are exclusive. */
+struct mf_rect_s
+{
+    int16_t x0;
+    int16_t y0;
+    int16_t x1;
+    int16_t y1;
+};
+
+/* Point where the decoding of a character can continue when its rows are
+ * rendered in several parts from top to bottom, e.g. by mf_band_render().
+ * The fields are only meaningful to the font that filled them in. Both are
+ * zero before the first part is rendered. */
+struct mf_resume_s
+{
+    /* Offset of the next data to decode in the glyph. */
+    uint16_t offset;
+
+    /* Index of the pixel in the glyph where the data starts. */
+    uint16_t pixel;
+};
+
+/* Edges of the glyphs for a range of characters, see mf_kerning_table_s. */
+struct mf_kerning_edges_s
+{
+    uint16_t first_char;
+    uint16_t char_count;
+
+    /* For each character, the leftmost pixel of the glyph in each kerning
+     * zone, followed by the rightmost pixel in each zone. Empty zones have
+     * left edge 255 and right edge 0. */
+    const uint8_t *edges;
+};
+
+/* Kerning information computed by the encoder, so that mf_compute_kerning()
+ * does not need to render the glyphs. The font can have adjustments for
+ * the pairs of the first characters, or the edges of each glyph, which
+ * take less space in fonts with many characters. */
+struct mf_kerning_table_s
+{
+    /* The kerning settings of mf_config.h that the table was computed
+     * with. The pairs are used only if all of these match, and the edges
+     * only if the zone count matches. */
+    uint8_t space_percent;
+    uint8_t space_pixels;
+    uint8_t limit;
+    uint8_t zone_count;
+
+    /* The pairs cover the characters below pair_char_limit, at most 256.
+     * Pairs of other characters are analyzed when needed. */
+    uint16_t pair_char_limit;
+
+    /* Number of character pairs that have a nonzero adjustment. */
+    uint16_t pair_count;
+
+    /* The first and second character of each pair, sorted. */
+    const uint8_t *pair_chars;
+
+    /* The adjustment of each pair, as int8_t values. */
+    const uint8_t *pair_adjust;
+
+    /* Edges of the glyphs for each range of characters. */
+    uint8_t edge_range_count;
+    const struct mf_kerning_edges_s *edge_ranges;
+};
+
+/* Ink bounding boxes of the glyphs for a range of characters. */
+struct mf_ink_range_s
+{
+    uint16_t first_char;
+    uint16_t char_count;
+
+    /* For each character, the amount of white space at the left, top,
+     * right and bottom edges, as returned by mf_character_whitespace(). */
+    const uint8_t *boxes;
+};
+
+/* Ink bounding boxes computed by the encoder, so that
+ * mf_character_whitespace() does not need to render the glyphs. */
+struct mf_ink_table_s
+{
+    uint8_t range_count;
+    const struct mf_ink_range_s *ranges;
+};
+
 /* General information about a font. */
 struct mf_font_s
 {
@@ -61,6 +177,26 @@ struct mf_font_s
                                 mf_char character,
                                 mf_pixel_callback_t callback,
                                 void *state);
+
+    /* Precomputed kerning, or NULL to analyze the glyphs when needed. */
+    const struct mf_kerning_table_s *kerning;
+
+    /* Precomputed ink bounding boxes, or NULL to render the glyphs. */
+    const struct mf_ink_table_s *ink_boxes;
+
+    /* Function to render only the rows from clip_y0 up to, but not
+     * including, clip_y1 of a character, or NULL if the font can only
+     * render whole characters. If resume is not NULL, decoding continues
+     * from the point stored in it by the previous call for the same
+     * character, and the point for the next call is stored back. Returns
+     * the same as render_character. */
+    uint8_t (*render_rows)(const struct mf_font_s *font,
+                           int16_t x0, int16_t y0,
+                           mf_char character,
+                           int16_t clip_y0, int16_t clip_y1,
+                           struct mf_resume_s *resume,
+                           mf_pixel_callback_t callback,
+                           void *state);
 };
 
 /* The flag definitions for the font.flags field. */
@@ -69,6 +205,12 @@ struct mf_font_s
 #define MF_FONT_FLAG_ITALIC    0x04
 #define MF_FONT_FLAG_BOLD      0x08
 
+/* Number of characters covered by the optional range maps of the font
+ * formats. The map gives the character range index of each character
+ * directly, or MF_RANGE_MAP_NONE if the character is not in the font. */
+#define MF_RANGE_MAP_SIZE 256
+#define MF_RANGE_MAP_NONE 255
+
 /* Lookup structure for searching fonts by name. */
 struct mf_font_list_s
 {
@@ -93,6 +235,71 @@ MF_EXTERN uint8_t mf_render_character(const struct mf_font_s *font,
                                       mf_pixel_callback_t callback,
                                       void *state);
 
+/* Function to decode and render the part of a single character that is
+ * inside a clip rectangle. Characters that are entirely outside of it are
+ * not decoded at all, and fonts that support it stop decoding after the
+ * last visible row.
+ *
+ * font:      Pointer to the font definition.
+ * x0, y0:    Upper left corner of the target area.
+ * character: The character code (unicode) to render.
+ * clip:      Only the pixels inside this rectangle are passed to callback.
+ * callback:  Callback function to write out the pixels.
+ * state:     Free variable for caller to use (can be NULL).
+ *
+ * Returns width of the character.
+ */
+MF_EXTERN uint8_t mf_render_character_clipped(const struct mf_font_s *font,
+                                              int16_t x0, int16_t y0,
+                                              mf_char character,
+                                              const struct mf_rect_s *clip,
+                                              mf_pixel_callback_t callback,
+                                              void *state);
+
+/* Function to decode and render a single character a row at a time.
+ * This is the same as mf_render_character(), except that the runs of
+ * pixels on each row are collected and passed to the callback at once.
+ * A row may still be passed in several calls, e.g. if it has more than
+ * MF_ROW_SPANS_MAX runs or the font is scaled.
+ *
+ * font:      Pointer to the font definition.
+ * x0, y0:    Upper left corner of the target area.
+ * character: The character code (unicode) to render.
+ * callback:  Callback function to write out the rows.
+ * state:     Free variable for caller to use (can be NULL).
+ *
+ * Returns width of the character.
+ */
+MF_EXTERN uint8_t mf_render_character_rows(const struct mf_font_s *font,
+                                           int16_t x0, int16_t y0,
+                                           mf_char character,
+                                           mf_row_callback_t callback,
+                                           void *state);
+
+/* Function to decode and render a single character as bit masks, for
+ * writing whole words at once to black & white framebuffers. The pixels
+ * with alpha of at least 128 are set. Each row is passed in one or more
+ * 32-bit masks. The masks start at a multiple of align pixels, so that
+ * e.g. with align 8 they can be written to a framebuffer with one bit per
+ * pixel by shifting whole bytes. The masks may come in any order.
+ *
+ * font:      Pointer to the font definition.
+ * x0, y0:    Upper left corner of the target area.
+ * character: The character code (unicode) to render.
+ * align:     1 to start the masks at the first pixel, or a power of two
+ *            up to 32.
+ * callback:  Callback function to write out the masks.
+ * state:     Free variable for caller to use (can be NULL).
+ *
+ * Returns width of the character.
+ */
+MF_EXTERN uint8_t mf_render_character_masks(const struct mf_font_s *font,
+                                            int16_t x0, int16_t y0,
+                                            mf_char character,
+                                            uint8_t align,
+                                            mf_mask_callback_t callback,
+                                            void *state);
+
 /* Function to get the width of a single character.
  * This is not necessarily the bounding box of the character
  * data, but rather the tracking width.
@@ -138,7 +345,15 @@ MF_EXTERN const struct mf_font_s *mf_find_font(const char *name);
 /* Get the list of included fonts */
 MF_EXTERN const struct mf_font_list_s *mf_get_font_list(void);
 
-/* Make a font from an array of bytes. 
+/* Make a font from an array of bytes, the contents of a .mff file.
+ * Only the font structure and the character ranges are allocated; the
+ * glyph data is used in place, so the array must stay valid until the font
+ * is destroyed. It can e.g. be a memory mapped file. The array must be
+ * aligned to 4 bytes, since the tables of rlefonts are read in place.
+ *
+ * Returns NULL if the file is not a supported font, if a table does not fit
+ * in len bytes or is misaligned, or if out of memory. The glyph data is not
+ * decoded here, only checked to start inside the file.
  */
 MF_EXTERN struct mf_font_s* mf_make_font(uint8_t* bulk, uint32_t len);
 
@@ -0,0 +1,328 @@
+#include "mf_framebuffer.h"
+#include "mf_bwfont.h"
+
+#ifndef MF_RLEFONT_INTERNALS
+#define MF_RLEFONT_INTERNALS
+#endif
+#include "mf_rlefont.h"
+#include <stdbool.h>
+#include <string.h>
+
+/* Limit a pixel run to the clip rectangle. Returns false if nothing is
+ * left of it. */
+static bool clip_run(const struct mf_framebuffer_s *fb,
+                     int16_t *x, int16_t y, uint8_t *count)
+{
+    int16_t x1 = *x + *count;
+
+    if (y < fb->clip_y0 || y >= fb->clip_y1)
+        return false;
+
+    if (*x < fb->clip_x0)
+        *x = fb->clip_x0;
+
+    if (x1 > fb->clip_x1)
+        x1 = fb->clip_x1;
+
+    if (x1 <= *x)
+        return false;
+
+    *count = x1 - *x;
+    return true;
+}
+
+/* Blend a pixel value towards the text color. */
+static uint8_t blend(uint8_t old, uint8_t color, uint8_t alpha)
+{
+    return ((uint32_t)old * (255 - alpha) + (uint32_t)color * alpha + 127) / 255;
+}
+
+/* Black & white pixels, whole bytes are filled at once. */
+static void write_1bpp(const struct mf_framebuffer_s *fb,
+                       int16_t x, int16_t y, uint8_t count, uint8_t alpha)
+{
+    uint8_t *p, mask;
+    uint8_t start, n;
+
+    if (alpha < 128 || !clip_run(fb, &x, y, &count))
+        return;
+
+    p = fb->pixels + (uint32_t)fb->stride * y + (x >> 3);
+    start = x & 7;
+
+    while (count)
+    {
+        n = 8 - start;
+        if (n > count)
+            n = count;
+
+        mask = (0xFF >> start) & ~(0xFF >> (start + n));
+
+        if (fb->color)
+            *p |= mask;
+        else
+            *p &= ~mask;
+
+        p++;
+        count -= n;
+        start = 0;
+    }
+}
+
+/* Black & white pixels in pages of 8 rows, one bit in each byte. */
+static void write_1bpp_pages(const struct mf_framebuffer_s *fb,
+                             int16_t x, int16_t y, uint8_t count,
+                             uint8_t alpha)
+{
+    uint8_t *p, mask;
+
+    if (alpha < 128 || !clip_run(fb, &x, y, &count))
+        return;
+
+    p = fb->pixels + (uint32_t)fb->stride * (y >> 3) + x;
+    mask = 1 << (y & 7);
+
+    if (fb->color)
+    {
+        while (count--)
+            *p++ |= mask;
+    }
+    else
+    {
+        while (count--)
+            *p++ &= ~mask;
+    }
+}
+
+/* Gray levels packed several pixels to a byte. Opaque runs are written a
+ * byte at a time, only the partially covered bytes at the ends are masked. */
+static void write_packed(const struct mf_framebuffer_s *fb,
+                         int16_t x, int16_t y, uint8_t count,
+                         uint8_t alpha, uint8_t bits)
+{
+    uint8_t *row, *p;
+    uint8_t per_byte, max, shift, old;
+    uint8_t fill, mask, start, n;
+
+    if (!clip_run(fb, &x, y, &count))
+        return;
+
+    row = fb->pixels + (uint32_t)fb->stride * y;
+    per_byte = 8 / bits;
+    max = (1 << bits) - 1;
+
+    if (alpha == 255)
+    {
+        fill = (fb->color & max) * (0xFF / max);
+        p = row + x / per_byte;
+        start = x % per_byte;
+
+        while (count)
+        {
+            if (start == 0 && count >= per_byte)
+            {
+                n = count / per_byte;
+                memset(p, fill, n);
+                p += n;
+                count -= n * per_byte;
+                continue;
+            }
+
+            n = per_byte - start;
+            if (n > count)
+                n = count;
+
+            mask = (0xFF >> (bits * start)) & ~(0xFF >> (bits * (start + n)));
+            *p = (*p & ~mask) | (fill & mask);
+
+            p++;
+            count -= n;
+            start = 0;
+        }
+        return;
+    }
+
+    while (count--)
+    {
+        p = row + x / per_byte;
+        shift = 8 - bits * (x % per_byte + 1);
+        old = (*p >> shift) & max;
+        old = blend(old, fb->color, alpha);
+        *p = (*p & ~(max << shift)) | ((old & max) << shift);
+        x++;
+    }
+}
+
+/* One byte per pixel, opaque runs are simply filled. */
+static void write_8bpp(const struct mf_framebuffer_s *fb,
+                       int16_t x, int16_t y, uint8_t count, uint8_t alpha)
+{
+    uint8_t *p;
+
+    if (!clip_run(fb, &x, y, &count))
+        return;
+
+    p = fb->pixels + (uint32_t)fb->stride * y + x;
+
+    if (alpha == 255)
+    {
+        memset(p, fb->color, count);
+        return;
+    }
+
+    while (count--)
+    {
+        *p = blend(*p, fb->color, alpha);
+        p++;
+    }
+}
+
+/* 16-bit color, each channel is blended separately. */
+static void write_rgb565(const struct mf_framebuffer_s *fb,
+                         int16_t x, int16_t y, uint8_t count, uint8_t alpha)
+{
+    uint16_t *p, old;
+    uint8_t r, g, b;
+
+    if (!clip_run(fb, &x, y, &count))
+        return;
+
+    p = (uint16_t*)(fb->pixels + (uint32_t)fb->stride * y) + x;
+
+    if (alpha == 255)
+    {
+        while (count--)
+            *p++ = fb->color;
+        return;
+    }
+
+    while (count--)
+    {
+        old = *p;
+        r = blend(old >> 11, fb->color >> 11, alpha);
+        g = blend((old >> 5) & 0x3F, (fb->color >> 5) & 0x3F, alpha);
+        b = blend(old & 0x1F, fb->color & 0x1F, alpha);
+        *p++ = ((uint16_t)r << 11) | ((uint16_t)g << 5) | b;
+    }
+}
+
+void mf_framebuffer_write_run(const struct mf_framebuffer_s *fb,
+                              int16_t x, int16_t y, uint8_t count,
+                              uint8_t alpha)
+{
+    switch (fb->format)
+    {
+        case MF_PIXEL_FORMAT_1BPP:
+            write_1bpp(fb, x, y, count, alpha);
+            break;
+        case MF_PIXEL_FORMAT_2BPP:
+            write_packed(fb, x, y, count, alpha, 2);
+            break;
+        case MF_PIXEL_FORMAT_4BPP:
+            write_packed(fb, x, y, count, alpha, 4);
+            break;
+        case MF_PIXEL_FORMAT_RGB565:
+            write_rgb565(fb, x, y, count, alpha);
+            break;
+        case MF_PIXEL_FORMAT_1BPP_PAGES:
+            write_1bpp_pages(fb, x, y, count, alpha);
+            break;
+        default:
+            write_8bpp(fb, x, y, count, alpha);
+            break;
+    }
+}
+
+/* Pixel callbacks for fonts that cannot write to the framebuffer
+ * themselves. */
+static void callback_1bpp(int16_t x, int16_t y, uint8_t count,
+                          uint8_t alpha, void *state)
+{
+    write_1bpp(state, x, y, count, alpha);
+}
+
+static void callback_2bpp(int16_t x, int16_t y, uint8_t count,
+                          uint8_t alpha, void *state)
+{
+    write_packed(state, x, y, count, alpha, 2);
+}
+
+static void callback_4bpp(int16_t x, int16_t y, uint8_t count,
+                          uint8_t alpha, void *state)
+{
+    write_packed(state, x, y, count, alpha, 4);
+}
+
+static void callback_8bpp(int16_t x, int16_t y, uint8_t count,
+                          uint8_t alpha, void *state)
+{
+    write_8bpp(state, x, y, count, alpha);
+}
+
+static void callback_rgb565(int16_t x, int16_t y, uint8_t count,
+                            uint8_t alpha, void *state)
+{
+    write_rgb565(state, x, y, count, alpha);
+}
+
+static void callback_1bpp_pages(int16_t x, int16_t y, uint8_t count,
+                                uint8_t alpha, void *state)
+{
+    write_1bpp_pages(state, x, y, count, alpha);
+}
+
+mf_pixel_callback_t mf_framebuffer_callback(const struct mf_framebuffer_s *fb)
+{
+    switch (fb->format)
+    {
+        case MF_PIXEL_FORMAT_1BPP:       return callback_1bpp;
+        case MF_PIXEL_FORMAT_2BPP:       return callback_2bpp;
+        case MF_PIXEL_FORMAT_4BPP:       return callback_4bpp;
+        case MF_PIXEL_FORMAT_RGB565:     return callback_rgb565;
+        case MF_PIXEL_FORMAT_1BPP_PAGES: return callback_1bpp_pages;
+        default:                         return callback_8bpp;
+    }
+}
+
+/* Render a character with the decoder of a bwfont or rlefont writing
+ * straight into the framebuffer. Returns 0 if the character is missing. */
+static uint8_t render_direct(const struct mf_framebuffer_s *fb,
+                             const struct mf_font_s *font,
+                             int16_t x0, int16_t y0, mf_char character)
+{
+    if (font->render_character == &mf_bwfont_render_character)
+    {
+        if (fb->format == MF_PIXEL_FORMAT_1BPP_PAGES)
+            return mf_bwfont_render_pages(font, x0, y0, character, fb);
+        else
+            return mf_bwfont_render_framebuffer(font, x0, y0, character, fb);
+    }
+    else if (font->render_character == &mf_rlefont_render_character)
+    {
+        return mf_rlefont_render_framebuffer(font, x0, y0, character, fb);
+    }
+
+    return 0;
+}
+
+uint8_t mf_framebuffer_render_character(const struct mf_framebuffer_s *fb,
+                                        const struct mf_font_s *font,
+                                        int16_t x0, int16_t y0,
+                                        mf_char character)
+{
+    uint8_t width;
+
+    if (font->render_character != &mf_bwfont_render_character &&
+        font->render_character != &mf_rlefont_render_character)
+    {
+        return mf_render_character(font, x0, y0, character,
+                                   mf_framebuffer_callback(fb), (void*)fb);
+    }
+
+    width = render_direct(fb, font, x0, y0, character);
+
+    if (!width)
+        width = render_direct(fb, font, x0, y0, font->fallback_character);
+
+    return width;
+}
@@ -0,0 +1,96 @@
+/* Rendering directly into a framebuffer in memory. Instead of writing a
+ * pixel callback for the display, the application can describe its
+ * framebuffer and use the ready-made callbacks, which blend the pixel runs
+ * into the buffer with code specialized for each pixel format.
+ */
+
+#ifndef _MF_FRAMEBUFFER_H_
+#define _MF_FRAMEBUFFER_H_
+
+#include "mf_font.h"
+
+/* Supported pixel formats. The sub-byte formats store the leftmost pixel
+ * in the most significant bits of the byte. */
+enum mf_pixel_format_t
+{
+    MF_PIXEL_FORMAT_1BPP = 0,  /* Black & white, alpha is thresholded. */
+    MF_PIXEL_FORMAT_2BPP,      /* 4 gray levels. */
+    MF_PIXEL_FORMAT_4BPP,      /* 16 gray levels. */
+    MF_PIXEL_FORMAT_8BPP,      /* 256 gray levels. */
+    MF_PIXEL_FORMAT_RGB565,    /* 16-bit color, in native byte order. */
+    MF_PIXEL_FORMAT_1BPP_PAGES /* Black & white, in pages of 8 rows. */
+};
+
+/* In the MF_PIXEL_FORMAT_1BPP_PAGES format, used by e.g. SSD1306 displays,
+ * each byte is a column of 8 pixels with the top pixel in the least
+ * significant bit. The bytes of a page go from left to right, and the
+ * stride is the number of bytes from one page to the next. */
+
+/* Description of a framebuffer to render to. */
+struct mf_framebuffer_s
+{
+    /* Pointer to the pixel at (0, 0). */
+    uint8_t *pixels;
+
+    /* Number of bytes from the start of one row to the start of the next,
+     * or from one page to the next in MF_PIXEL_FORMAT_1BPP_PAGES. */
+    uint16_t stride;
+
+    /* Format of the pixels, one of mf_pixel_format_t. */
+    uint8_t format;
+
+    /* Color of the text, as a value in the pixel format. The pixels are
+     * blended towards it according to the alpha of the glyph. */
+    uint16_t color;
+
+    /* Clip rectangle. Pixels outside of it are not touched.
+     * The right and bottom edges are exclusive. */
+    int16_t clip_x0;
+    int16_t clip_y0;
+    int16_t clip_x1;
+    int16_t clip_y1;
+};
+
+/* Get the pixel callback that renders into the given framebuffer. The
+ * framebuffer itself is passed as the state of the callback, e.g.
+ *
+ * mf_render_character(font, x, y, c, mf_framebuffer_callback(&fb), &fb);
+ *
+ * fb: Framebuffer to render to.
+ *
+ * Returns the callback, specialized for the pixel format of fb.
+ */
+MF_EXTERN mf_pixel_callback_t mf_framebuffer_callback(const struct mf_framebuffer_s *fb);
+
+/* Render a character into the framebuffer. The bwfont and rlefont decoders
+ * write the pixel runs straight into the framebuffer, without going through
+ * a pixel callback, and skip the rows outside of the clip rectangle. In
+ * MF_PIXEL_FORMAT_1BPP_PAGES framebuffers, column major bwfont glyphs are
+ * copied a byte at a time, because their data is already in the page
+ * format. Other fonts are rendered through mf_framebuffer_callback().
+ *
+ * fb:        Framebuffer to render to.
+ * font:      Pointer to the font definition.
+ * x0, y0:    Upper left corner of the target area.
+ * character: The character code (unicode) to render.
+ *
+ * Returns width of the character.
+ */
+MF_EXTERN uint8_t mf_framebuffer_render_character(const struct mf_framebuffer_s *fb,
+                                                  const struct mf_font_s *font,
+                                                  int16_t x0, int16_t y0,
+                                                  mf_char character);
+
+/* Write a run of pixels into the framebuffer. This is used by the font
+ * decoders that render into the framebuffer themselves.
+ *
+ * fb:    Framebuffer to render to.
+ * x, y:  Position of the first pixel of the run.
+ * count: Number of pixels in the run.
+ * alpha: Alpha value of the pixels, 0 to 255.
+ */
+MF_EXTERN void mf_framebuffer_write_run(const struct mf_framebuffer_s *fb,
+                                        int16_t x, int16_t y, uint8_t count,
+                                        uint8_t alpha);
+
+#endif
@@ -0,0 +1,187 @@
+#include "mf_glyphcache.h"
+#include <stdbool.h>
+
+#if MF_USE_GLYPH_CACHE
+
+/* Each pixel run is stored as x, y relative to the glyph origin,
+ * followed by the pixel count and alpha. */
+#define SPAN_SIZE 4
+
+/* Information about a single cached glyph. */
+struct cache_entry_s
+{
+    const struct mf_font_s *font;
+    mf_char character;
+
+    /* Width of the character, or 0 if the entry is not in use. */
+    uint8_t width;
+
+    /* Number of pixel runs stored in the data of the entry. */
+    uint16_t span_count;
+
+    /* Value of the cache clock when the entry was last used. */
+    uint32_t last_used;
+};
+
+/* State of the cache. The glyph data is in the buffer given by the caller,
+ * divided in equal slots for each entry. */
+static struct
+{
+    struct cache_entry_s entries[MF_GLYPH_CACHE_ENTRIES];
+    uint8_t *data;
+    uint16_t slot_spans;
+    uint32_t clock;
+    uint32_t hits;
+    uint32_t misses;
+    bool busy;
+} cache;
+
+/* State for storing the pixel runs of a glyph as it is rendered. */
+struct record_state_s
+{
+    mf_pixel_callback_t callback;
+    void *state;
+    int16_t x0;
+    int16_t y0;
+    uint8_t *data;
+    uint16_t span_count;
+    bool overflow;
+};
+
+/* Pixel callback that passes the pixels on and also stores them. */
+static void record_callback(int16_t x, int16_t y, uint8_t count,
+                            uint8_t alpha, void *state)
+{
+    struct record_state_s *s = state;
+    int16_t dx = x - s->x0;
+    int16_t dy = y - s->y0;
+
+    s->callback(x, y, count, alpha, s->state);
+
+    if (s->overflow)
+        return;
+
+    if (s->span_count >= cache.slot_spans ||
+        dx < 0 || dx > 255 || dy < 0 || dy > 255)
+    {
+        s->overflow = true;
+        return;
+    }
+
+    s->data[0] = dx;
+    s->data[1] = dy;
+    s->data[2] = count;
+    s->data[3] = alpha;
+    s->data += SPAN_SIZE;
+    s->span_count++;
+}
+
+void mf_glyphcache_init(void *buffer, uint32_t size)
+{
+    uint32_t spans;
+
+    spans = size / MF_GLYPH_CACHE_ENTRIES / SPAN_SIZE;
+    if (spans > 0xFFFF)
+        spans = 0xFFFF;
+
+    cache.data = (spans > 0) ? buffer : 0;
+    cache.slot_spans = spans;
+    cache.hits = 0;
+    cache.misses = 0;
+    mf_glyphcache_clear();
+}
+
+void mf_glyphcache_clear(void)
+{
+    uint16_t i;
+    for (i = 0; i < MF_GLYPH_CACHE_ENTRIES; i++)
+    {
+        cache.entries[i].width = 0;
+        cache.entries[i].last_used = 0;
+    }
+
+    cache.clock = 0;
+}
+
+void mf_glyphcache_get_stats(uint32_t *hits, uint32_t *misses)
+{
+    if (hits) *hits = cache.hits;
+    if (misses) *misses = cache.misses;
+}
+
+uint8_t mf_glyphcache_render(const struct mf_font_s *font,
+                             int16_t x0, int16_t y0,
+                             mf_char character,
+                             mf_pixel_callback_t callback,
+                             void *state,
+                             uint8_t (*render)(const struct mf_font_s *font,
+                                               int16_t x0, int16_t y0,
+                                               mf_char character,
+                                               mf_pixel_callback_t callback,
+                                               void *state))
+{
+    struct cache_entry_s *entry, *victim;
+    struct record_state_s rstate;
+    const uint8_t *p;
+    uint16_t i, j;
+    uint8_t width;
+
+    /* Fonts that render other fonts may end up here recursively. */
+    if (!cache.data || cache.busy)
+        return render(font, x0, y0, character, callback, state);
+
+    cache.clock++;
+    victim = &cache.entries[0];
+
+    for (i = 0; i < MF_GLYPH_CACHE_ENTRIES; i++)
+    {
+        entry = &cache.entries[i];
+
+        if (entry->width && entry->font == font && entry->character == character)
+        {
+            entry->last_used = cache.clock;
+            cache.hits++;
+
+            p = cache.data + (uint32_t)i * cache.slot_spans * SPAN_SIZE;
+            for (j = 0; j < entry->span_count; j++, p += SPAN_SIZE)
+            {
+                callback(x0 + p[0], y0 + p[1], p[2], p[3], state);
+            }
+
+            return entry->width;
+        }
+
+        if (entry->last_used < victim->last_used)
+            victim = entry;
+    }
+
+    /* Replace the least recently used entry with the new glyph. */
+    cache.misses++;
+    victim->width = 0;
+    victim->last_used = 0;
+
+    rstate.callback = callback;
+    rstate.state = state;
+    rstate.x0 = x0;
+    rstate.y0 = y0;
+    rstate.data = cache.data + (uint32_t)(victim - cache.entries) * cache.slot_spans * SPAN_SIZE;
+    rstate.span_count = 0;
+    rstate.overflow = false;
+
+    cache.busy = true;
+    width = render(font, x0, y0, character, record_callback, &rstate);
+    cache.busy = false;
+
+    if (width && !rstate.overflow)
+    {
+        victim->font = font;
+        victim->character = character;
+        victim->width = width;
+        victim->span_count = rstate.span_count;
+        victim->last_used = cache.clock;
+    }
+
+    return width;
+}
+
+#endif
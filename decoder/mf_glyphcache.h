@@ -0,0 +1,61 @@
+/* Cache for recently rendered glyphs. When the same characters are drawn
+ * over and over again, e.g. when updating a display every frame, the
+ * cached glyphs are replayed to the pixel callback without decoding the
+ * compressed font data again.
+ *
+ * The cache is enabled with MF_USE_GLYPH_CACHE in mf_config.h. The memory
+ * for the glyphs is given by the caller with mf_glyphcache_init().
+ */
+
+#ifndef _MF_GLYPHCACHE_H_
+#define _MF_GLYPHCACHE_H_
+
+#include "mf_config.h"
+#include "mf_font.h"
+
+#if MF_USE_GLYPH_CACHE
+
+/* Start using the given buffer for the glyph cache. The buffer is divided
+ * evenly between MF_GLYPH_CACHE_ENTRIES glyphs, and each glyph takes 4
+ * bytes per pixel run. Glyphs that do not fit in their share of the buffer
+ * are rendered without caching. Any previous contents are discarded.
+ *
+ * buffer: Memory to use for the cache, or NULL to disable the cache.
+ * size:   Size of the buffer in bytes.
+ */
+MF_EXTERN void mf_glyphcache_init(void *buffer, uint32_t size);
+
+/* Discard all the cached glyphs. This must be called if a font that has
+ * glyphs in the cache is modified or freed, except that mf_destroy_font()
+ * does it automatically.
+ */
+MF_EXTERN void mf_glyphcache_clear(void);
+
+/* Get the number of cache hits and misses since the cache was initialized.
+ *
+ * hits:   Number of glyphs replayed from the cache. Can be NULL.
+ * misses: Number of glyphs that had to be decoded. Can be NULL.
+ */
+MF_EXTERN void mf_glyphcache_get_stats(uint32_t *hits, uint32_t *misses);
+
+/* Render a character through the cache. This is used internally by
+ * mf_render_character(), which passes the function that decodes the glyph
+ * in case it is not found in the cache.
+ */
+MF_EXTERN uint8_t mf_glyphcache_render(const struct mf_font_s *font,
+                                       int16_t x0, int16_t y0,
+                                       mf_char character,
+                                       mf_pixel_callback_t callback,
+                                       void *state,
+                                       uint8_t (*render)(const struct mf_font_s *font,
+                                                         int16_t x0, int16_t y0,
+                                                         mf_char character,
+                                                         mf_pixel_callback_t callback,
+                                                         void *state));
+
+#else
+#define mf_glyphcache_init(b,s)
+#define mf_glyphcache_clear()
+#endif
+
+#endif
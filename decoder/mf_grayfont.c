@@ -0,0 +1,205 @@
+#include "mf_grayfont.h"
+
+/* Find the character range and index that contains a given glyph.
+ * Uses the range map if the font has one, otherwise a binary search. */
+static const struct mf_grayfont_char_range_s *find_char_range(
+    const struct mf_grayfont_s *font, uint16_t character, uint16_t *index_ret)
+{
+    unsigned low, high, mid;
+    const struct mf_grayfont_char_range_s *range;
+
+    if (font->range_map && character < MF_RANGE_MAP_SIZE)
+    {
+        mid = pgm_read_byte(font->range_map + character);
+        if (mid >= font->char_range_count)
+            return 0;
+
+        range = &font->char_ranges[mid];
+        *index_ret = character - range->first_char;
+        return range;
+    }
+
+    low = 0;
+    high = font->char_range_count;
+    while (low < high)
+    {
+        mid = (low + high) / 2;
+        range = &font->char_ranges[mid];
+
+        if (character < range->first_char)
+        {
+            high = mid;
+        }
+        else if (character - range->first_char >= range->char_count)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            *index_ret = character - range->first_char;
+            return range;
+        }
+    }
+
+    return 0;
+}
+
+/* Find the data of a glyph, or NULL if the glyph is missing. */
+static const uint8_t *get_glyph_data(const struct mf_grayfont_char_range_s *r,
+                                     uint16_t index)
+{
+    uint16_t offset, next;
+
+    offset = pgm_read_word(r->glyph_offsets + index);
+    next = pgm_read_word(r->glyph_offsets + index + 1);
+
+    return (offset == next) ? 0 : r->glyph_data + offset;
+}
+
+/* Render a row of packed pixels, merging neighbours of the same alpha into
+ * a single run. Bytes of empty pixels are skipped as a whole. */
+static void render_gray_row(const uint8_t *p, uint8_t count, uint8_t bits,
+                            int16_t x0, int16_t y,
+                            mf_pixel_callback_t callback,
+                            void *state)
+{
+    uint16_t x, start;
+    uint8_t byte, shift, mask, scale, per_byte, value, run_value;
+
+    mask = (1 << bits) - 1;
+    scale = 255 / mask;
+    per_byte = 8 / bits;
+
+    byte = 0;
+    shift = 0;
+    start = 0;
+    run_value = 0;
+    for (x = 0; x < count; x++)
+    {
+        if (!shift)
+        {
+            byte = pgm_read_byte(p++);
+            shift = 8;
+
+            if (!byte && !run_value)
+            {
+                x += per_byte - 1;
+                shift = 0;
+                continue;
+            }
+        }
+
+        shift -= bits;
+        value = (byte >> shift) & mask;
+
+        if (value != run_value)
+        {
+            if (run_value)
+                callback(x0 + start, y, x - start, run_value * scale, state);
+
+            run_value = value;
+            start = x;
+        }
+    }
+
+    if (run_value)
+        callback(x0 + start, y, count - start, run_value * scale, state);
+}
+
+/* Render the rows from clip_y0 to clip_y1 of a glyph. */
+static uint8_t render_char(const struct mf_grayfont_s *font,
+                           const struct mf_grayfont_char_range_s *r,
+                           int16_t x0, int16_t y0, uint16_t index,
+                           int16_t clip_y0, int16_t clip_y1,
+                           mf_pixel_callback_t callback,
+                           void *state)
+{
+    const uint8_t *data, *box;
+    uint8_t width, height, row_bytes, y;
+
+    data = get_glyph_data(r, index);
+    if (!data)
+        return 0;
+
+    box = r->glyph_boxes + (uint32_t)index * 4;
+    x0 += pgm_read_byte(box);
+    y0 += pgm_read_byte(box + 1);
+    width = pgm_read_byte(box + 2);
+    height = pgm_read_byte(box + 3);
+    row_bytes = ((uint16_t)width * font->bits_per_pixel + 7) / 8;
+
+    /* The rows are independent, so the clipped ones are simply skipped. */
+    y = 0;
+    if (clip_y0 > y0)
+        y = (clip_y0 - y0 < height) ? clip_y0 - y0 : height;
+    if (clip_y1 - y0 < height)
+        height = (clip_y1 > y0) ? clip_y1 - y0 : 0;
+
+    for (; y < height; y++)
+    {
+        render_gray_row(data + 1 + (uint16_t)y * row_bytes, width,
+                        font->bits_per_pixel, x0, y0 + y, callback, state);
+    }
+
+    return pgm_read_byte(data);
+}
+
+uint8_t mf_grayfont_render_character(const struct mf_font_s *font,
+                                     int16_t x0, int16_t y0,
+                                     mf_char character,
+                                     mf_pixel_callback_t callback,
+                                     void *state)
+{
+    const struct mf_grayfont_s *grayfont = (const struct mf_grayfont_s*)font;
+    const struct mf_grayfont_char_range_s *range;
+    uint16_t index;
+
+    range = find_char_range(grayfont, character, &index);
+    if (!range)
+        return 0;
+
+    return render_char(grayfont, range, x0, y0, index, INT16_MIN, INT16_MAX,
+                       callback, state);
+}
+
+uint8_t mf_grayfont_character_width(const struct mf_font_s *font,
+                                    mf_char character)
+{
+    const struct mf_grayfont_s *grayfont = (const struct mf_grayfont_s*)font;
+    const struct mf_grayfont_char_range_s *range;
+    const uint8_t *data;
+    uint16_t index;
+
+    range = find_char_range(grayfont, character, &index);
+    if (!range)
+        return 0;
+
+    data = get_glyph_data(range, index);
+    if (!data)
+        return 0;
+
+    return pgm_read_byte(data);
+}
+
+uint8_t mf_grayfont_render_rows(const struct mf_font_s *font,
+                                int16_t x0, int16_t y0,
+                                mf_char character,
+                                int16_t clip_y0, int16_t clip_y1,
+                                struct mf_resume_s *resume,
+                                mf_pixel_callback_t callback,
+                                void *state)
+{
+    const struct mf_grayfont_s *grayfont = (const struct mf_grayfont_s*)font;
+    const struct mf_grayfont_char_range_s *range;
+    uint16_t index;
+
+    /* Any row can be found directly, there is nothing to resume. */
+    (void)resume;
+
+    range = find_char_range(grayfont, character, &index);
+    if (!range)
+        return 0;
+
+    return render_char(grayfont, range, x0, y0, index, clip_y0, clip_y1,
+                       callback, state);
+}
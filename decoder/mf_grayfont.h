@@ -0,0 +1,79 @@
+/* Uncompressed font format for antialiased fonts. The pixels are stored
+ * as 2 or 4 bit alpha values, so that any row of a glyph can be found and
+ * rendered directly. Takes more space than the rlefont format, but is
+ * much faster to decode.
+ */
+
+#ifndef _MF_GRAYFONT_H_
+#define _MF_GRAYFONT_H_
+
+#include "mf_font.h"
+
+/* Versions of the gray font format that are supported. */
+#define MF_GRAYFONT_VERSION_1_SUPPORTED 1
+
+/* Structure for a range of characters. */
+struct mf_grayfont_char_range_s
+{
+    /* The number of the first character in this range. */
+    uint16_t first_char;
+
+    /* The total count of characters in this range. */
+    uint16_t char_count;
+
+    /* Byte offset of the data of each glyph, with one more entry at the
+     * end. A glyph is missing if its offset is the same as the next one. */
+    const uint16_t *glyph_offsets;
+
+    /* Box of each glyph within the font box, 4 bytes per glyph:
+     * x, y, width and height. The pixels outside of it are empty. */
+    const uint8_t *glyph_boxes;
+
+    /* Table for the glyph data. The data of each glyph is the width of the
+     * character, followed by the rows of the glyph box. Each row is packed
+     * in (width * bits_per_pixel + 7) / 8 bytes, with the leftmost pixel in
+     * the most significant bits of the first byte. */
+    const uint8_t *glyph_data;
+};
+
+/* Structure for the font */
+struct mf_grayfont_s
+{
+    struct mf_font_s font;
+
+    /* Version of the font format. */
+    uint8_t version;
+
+    /* Number of bits in each pixel, 2 or 4. */
+    uint8_t bits_per_pixel;
+
+    /* Number of character ranges. */
+    uint8_t char_range_count;
+
+    /* Array of the character ranges, sorted by first_char. */
+    const struct mf_grayfont_char_range_s *char_ranges;
+
+    /* Table of MF_RANGE_MAP_SIZE entries that maps the first characters
+     * directly to their character range, or NULL. */
+    const uint8_t *range_map;
+};
+
+/* Internal functions, don't use these directly. */
+MF_EXTERN uint8_t mf_grayfont_render_character(const struct mf_font_s *font,
+                                               int16_t x0, int16_t y0,
+                                               mf_char character,
+                                               mf_pixel_callback_t callback,
+                                               void *state);
+
+MF_EXTERN uint8_t mf_grayfont_character_width(const struct mf_font_s *font,
+                                              mf_char character);
+
+MF_EXTERN uint8_t mf_grayfont_render_rows(const struct mf_font_s *font,
+                                          int16_t x0, int16_t y0,
+                                          mf_char character,
+                                          int16_t clip_y0, int16_t clip_y1,
+                                          struct mf_resume_s *resume,
+                                          mf_pixel_callback_t callback,
+                                          void *state);
+
+#endif
@@ -330,3 +330,75 @@ void mf_render_justified(const struct mf_font_s *font,
 
 #endif
 
+
+/* State for skipping the characters that are outside of the clip. */
+struct clip_state_s
+{
+    const struct mf_font_s *font;
+    const struct mf_rect_s *clip;
+    mf_character_callback_t callback;
+    void *state;
+};
+
+/* Character callback that measures the characters outside of the clip
+ * instead of rendering them. */
+static uint8_t clip_character_callback(int16_t x0, int16_t y0,
+                                       mf_char character, void *state)
+{
+    struct clip_state_s *s = state;
+
+    if (x0 >= s->clip->x1 || x0 + s->font->width <= s->clip->x0)
+        return mf_character_width(s->font, character);
+
+    return s->callback(x0, y0, character, s->state);
+}
+
+/* Returns true if the line starting at y0 is entirely outside of the clip. */
+static bool line_is_clipped(const struct mf_font_s *font, int16_t y0,
+                            const struct mf_rect_s *clip)
+{
+    return y0 >= clip->y1 || y0 + font->height <= clip->y0;
+}
+
+void mf_render_aligned_clipped(const struct mf_font_s *font,
+                               int16_t x0, int16_t y0,
+                               enum mf_align_t align,
+                               mf_str text, uint16_t count,
+                               const struct mf_rect_s *clip,
+                               mf_character_callback_t callback,
+                               void *state)
+{
+    struct clip_state_s cstate;
+
+    if (line_is_clipped(font, y0, clip))
+        return;
+
+    cstate.font = font;
+    cstate.clip = clip;
+    cstate.callback = callback;
+    cstate.state = state;
+
+    mf_render_aligned(font, x0, y0, align, text, count,
+                      clip_character_callback, &cstate);
+}
+
+void mf_render_justified_clipped(const struct mf_font_s *font,
+                                 int16_t x0, int16_t y0, int16_t width,
+                                 mf_str text, uint16_t count,
+                                 const struct mf_rect_s *clip,
+                                 mf_character_callback_t callback,
+                                 void *state)
+{
+    struct clip_state_s cstate;
+
+    if (line_is_clipped(font, y0, clip))
+        return;
+
+    cstate.font = font;
+    cstate.clip = clip;
+    cstate.callback = callback;
+    cstate.state = state;
+
+    mf_render_justified(font, x0, y0, width, text, count,
+                        clip_character_callback, &cstate);
+}
@@ -70,5 +70,37 @@ MF_EXTERN void mf_render_justified(const struct mf_font_s *font,
                                    mf_character_callback_t callback,
                                    void *state);
 
+/* Render a single line of aligned text, skipping the parts outside of a
+ * clip rectangle. Lines above or below the clip return immediately, and
+ * the callback is only called for the characters that are at least partly
+ * inside it. The callback should itself limit the pixels to the clip, e.g.
+ * by using mf_render_character_clipped().
+ *
+ * clip:     Rectangle that limits the area that is rendered.
+ *
+ * The other parameters are the same as for mf_render_aligned().
+ */
+MF_EXTERN void mf_render_aligned_clipped(const struct mf_font_s *font,
+                                         int16_t x0, int16_t y0,
+                                         enum mf_align_t align,
+                                         mf_str text, uint16_t count,
+                                         const struct mf_rect_s *clip,
+                                         mf_character_callback_t callback,
+                                         void *state);
+
+/* Render a single line of justified text, skipping the parts outside of a
+ * clip rectangle, like mf_render_aligned_clipped().
+ *
+ * clip:     Rectangle that limits the area that is rendered.
+ *
+ * The other parameters are the same as for mf_render_justified().
+ */
+MF_EXTERN void mf_render_justified_clipped(const struct mf_font_s *font,
+                                           int16_t x0, int16_t y0, int16_t width,
+                                           mf_str text, uint16_t count,
+                                           const struct mf_rect_s *clip,
+                                           mf_character_callback_t callback,
+                                           void *state);
+
 
 #endif
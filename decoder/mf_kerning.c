@@ -55,6 +55,68 @@ static bool do_kerning(mf_char c)
     return true;
 }
 
+/* Can the pair table of the font be used for these characters? It is
+ * only valid for the settings it was computed with. */
+static bool use_kerning_pairs(const struct mf_kerning_table_s *kerning,
+                              mf_char c1, mf_char c2)
+{
+    return kerning->pair_char_limit &&
+           (uint16_t)c1 < kerning->pair_char_limit &&
+           (uint16_t)c2 < kerning->pair_char_limit &&
+           kerning->space_percent == MF_KERNING_SPACE_PERCENT &&
+           kerning->space_pixels == MF_KERNING_SPACE_PIXELS &&
+           kerning->limit == MF_KERNING_LIMIT &&
+           kerning->zone_count == MF_KERNING_ZONES;
+}
+
+/* Find the adjustment of a pair in the precomputed kerning table. */
+static int8_t find_kerning_pair(const struct mf_kerning_table_s *kerning,
+                                mf_char c1, mf_char c2)
+{
+    uint16_t low, high, mid, key, pair;
+
+    key = ((uint16_t)c1 << 8) | (uint16_t)c2;
+    low = 0;
+    high = kerning->pair_count;
+    while (low < high)
+    {
+        mid = low + (high - low) / 2;
+        pair = ((uint16_t)pgm_read_byte(kerning->pair_chars + 2 * mid) << 8) |
+               pgm_read_byte(kerning->pair_chars + 2 * mid + 1);
+
+        if (pair < key)
+            low = mid + 1;
+        else if (pair == key)
+            return (int8_t)pgm_read_byte(kerning->pair_adjust + mid);
+        else
+            high = mid;
+    }
+
+    return 0;
+}
+
+/* Find the precomputed edges of a glyph, or NULL if there are none. */
+static const uint8_t *find_edges(const struct mf_kerning_table_s *kerning,
+                                 mf_char character)
+{
+    const struct mf_kerning_edges_s *range;
+    uint16_t index;
+    uint8_t i;
+
+    if (kerning->zone_count != MF_KERNING_ZONES)
+        return 0;
+
+    for (i = 0; i < kerning->edge_range_count; i++)
+    {
+        range = &kerning->edge_ranges[i];
+        index = character - range->first_char;
+        if (character >= range->first_char && index < range->char_count)
+            return range->edges + (uint32_t)index * 2 * MF_KERNING_ZONES;
+    }
+
+    return 0;
+}
+
 /*static int16_t min16(int16_t a, int16_t b) { return (a < b) ? a : b; }*/
 static int16_t max16(int16_t a, int16_t b) { return (a > b) ? a : b; }
 static int16_t avg16(int16_t a, int16_t b) { return (a + b) / 2; }
@@ -63,6 +125,7 @@ int8_t mf_compute_kerning(const struct mf_font_s *font,
                           mf_char c1, mf_char c2)
 {
     struct kerning_state_s leftedge, rightedge;
+    const uint8_t *edges1 = 0, *edges2 = 0;
     uint8_t w1, w2, i, min_space;
     int16_t normal_space, adjust, max_adjust;
 
@@ -72,21 +135,51 @@ int8_t mf_compute_kerning(const struct mf_font_s *font,
     if (!do_kerning(c1) || !do_kerning(c2))
         return 0;
 
-    /* Compute the height of one kerning zone in pixels */
-    i = (font->height + MF_KERNING_ZONES - 1) / MF_KERNING_ZONES;
-    if (i < 1) i = 1;
-
-    /* Initialize structures */
-    leftedge.zoneheight = rightedge.zoneheight = i;
-    for (i = 0; i < MF_KERNING_ZONES; i++)
+    if (font->kerning)
     {
-        leftedge.edgepos[i] = 255;
-        rightedge.edgepos[i] = 0;
+        w1 = font->character_width(font, c1);
+        w2 = font->character_width(font, c2);
+
+        /* The tables only have the characters that are in the font. The
+         * others are rendered with the fallback character, which is
+         * analyzed below. */
+        if (w1 && w2)
+        {
+            if (use_kerning_pairs(font->kerning, c1, c2))
+                return find_kerning_pair(font->kerning, c1, c2);
+
+            edges1 = find_edges(font->kerning, c1);
+            edges2 = find_edges(font->kerning, c2);
+        }
     }
 
-    /* Analyze the edges of both glyphs. */
-    w1 = mf_render_character(font, 0, 0, c1, fit_rightedge, &rightedge);
-    w2 = mf_render_character(font, 0, 0, c2, fit_leftedge, &leftedge);
+    if (edges1 && edges2)
+    {
+        /* Take the edges of both glyphs from the table. */
+        for (i = 0; i < MF_KERNING_ZONES; i++)
+        {
+            rightedge.edgepos[i] = pgm_read_byte(edges1 + MF_KERNING_ZONES + i);
+            leftedge.edgepos[i] = pgm_read_byte(edges2 + i);
+        }
+    }
+    else
+    {
+        /* Compute the height of one kerning zone in pixels */
+        i = (font->height + MF_KERNING_ZONES - 1) / MF_KERNING_ZONES;
+        if (i < 1) i = 1;
+
+        /* Initialize structures */
+        leftedge.zoneheight = rightedge.zoneheight = i;
+        for (i = 0; i < MF_KERNING_ZONES; i++)
+        {
+            leftedge.edgepos[i] = 255;
+            rightedge.edgepos[i] = 0;
+        }
+
+        /* Analyze the edges of both glyphs. */
+        w1 = mf_render_character(font, 0, 0, c1, fit_rightedge, &rightedge);
+        w2 = mf_render_character(font, 0, 0, c2, fit_leftedge, &leftedge);
+    }
 
     /* Find the minimum horizontal space between the glyphs. */
     min_space = 255;
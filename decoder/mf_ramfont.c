@@ -0,0 +1,240 @@
+#include "mf_ramfont.h"
+#include <string.h>
+
+/* State for finding the box of the pixels of a glyph. */
+struct box_state_s
+{
+    int16_t x0;
+    int16_t y0;
+    int16_t x1;
+    int16_t y1;
+};
+
+static void box_callback(int16_t x, int16_t y, uint8_t count,
+                         uint8_t alpha, void *state)
+{
+    struct box_state_s *s = state;
+    (void)alpha;
+
+    if (x < s->x0) s->x0 = x;
+    if (y < s->y0) s->y0 = y;
+    if (x + count > s->x1) s->x1 = x + count;
+    if (y + 1 > s->y1) s->y1 = y + 1;
+}
+
+/* State for packing the pixels of a glyph into rows of 4 bit values. */
+struct pack_state_s
+{
+    uint8_t *data;
+    int16_t x0;
+    int16_t y0;
+    uint8_t row_bytes;
+};
+
+static void pack_callback(int16_t x, int16_t y, uint8_t count,
+                          uint8_t alpha, void *state)
+{
+    struct pack_state_s *s = state;
+    uint8_t *row, value;
+
+    value = (alpha + 8) / 17;
+    row = s->data + (uint16_t)(y - s->y0) * s->row_bytes;
+    x -= s->x0;
+
+    while (count--)
+    {
+        row[x >> 1] |= (x & 1) ? value : (value << 4);
+        x++;
+    }
+}
+
+static uint8_t ram_character_width(const struct mf_font_s *font,
+                                   mf_char character)
+{
+    const struct mf_ramfont_s *rfont = (const struct mf_ramfont_s*)font;
+    uint8_t width;
+
+    width = mf_grayfont_character_width(&rfont->subset.font, character);
+
+    if (!width)
+        width = rfont->basefont->character_width(rfont->basefont, character);
+
+    return width;
+}
+
+static uint8_t ram_render_character(const struct mf_font_s *font,
+                                    int16_t x0, int16_t y0,
+                                    mf_char character,
+                                    mf_pixel_callback_t callback,
+                                    void *state)
+{
+    const struct mf_ramfont_s *rfont = (const struct mf_ramfont_s*)font;
+    uint8_t width;
+
+    width = mf_grayfont_render_character(&rfont->subset.font, x0, y0,
+                                         character, callback, state);
+
+    if (!width)
+    {
+        width = rfont->basefont->render_character(rfont->basefont, x0, y0,
+                                                  character, callback, state);
+    }
+
+    return width;
+}
+
+static uint8_t ram_render_rows(const struct mf_font_s *font,
+                               int16_t x0, int16_t y0,
+                               mf_char character,
+                               int16_t clip_y0, int16_t clip_y1,
+                               struct mf_resume_s *resume,
+                               mf_pixel_callback_t callback,
+                               void *state)
+{
+    const struct mf_ramfont_s *rfont = (const struct mf_ramfont_s*)font;
+    uint8_t width;
+
+    width = mf_grayfont_render_rows(&rfont->subset.font, x0, y0, character,
+                                    clip_y0, clip_y1, resume,
+                                    callback, state);
+
+    if (!width)
+    {
+        width = rfont->basefont->render_rows(rfont->basefont, x0, y0,
+                                             character, clip_y0, clip_y1,
+                                             resume, callback, state);
+    }
+
+    return width;
+}
+
+/* Decode a glyph from the base font into data, as the width followed by
+ * the rows of its box. Returns the number of bytes used, or 0 if the
+ * glyph is missing or does not fit in size bytes. */
+static uint16_t transcode_glyph(const struct mf_font_s *basefont,
+                                mf_char character, uint8_t *box,
+                                uint8_t *data, uint16_t size)
+{
+    struct box_state_s bstate;
+    struct pack_state_s pstate;
+    uint8_t width;
+    uint16_t length;
+
+    bstate.x0 = bstate.y0 = INT16_MAX;
+    bstate.x1 = bstate.y1 = INT16_MIN;
+
+    width = basefont->render_character(basefont, 0, 0, character,
+                                       box_callback, &bstate);
+    if (!width)
+        return 0;
+
+    /* Glyph without any pixels, e.g. space. */
+    if (bstate.x1 < bstate.x0)
+        bstate.x0 = bstate.y0 = bstate.x1 = bstate.y1 = 0;
+
+    if (bstate.x0 < 0 || bstate.y0 < 0 || bstate.x1 > 255 || bstate.y1 > 255)
+        return 0;
+
+    pstate.data = data + 1;
+    pstate.x0 = bstate.x0;
+    pstate.y0 = bstate.y0;
+    pstate.row_bytes = (bstate.x1 - bstate.x0 + 1) / 2;
+
+    length = 1 + (uint16_t)pstate.row_bytes * (bstate.y1 - bstate.y0);
+    if (length > size)
+        return 0;
+
+    box[0] = bstate.x0;
+    box[1] = bstate.y0;
+    box[2] = bstate.x1 - bstate.x0;
+    box[3] = bstate.y1 - bstate.y0;
+
+    data[0] = width;
+    memset(pstate.data, 0, length - 1);
+    basefont->render_character(basefont, 0, 0, character,
+                               pack_callback, &pstate);
+
+    return length;
+}
+
+uint32_t mf_transcode_font(struct mf_ramfont_s *newfont,
+                           const struct mf_font_s *basefont,
+                           const mf_char *chars, uint16_t char_count,
+                           void *buffer, uint32_t size)
+{
+    struct mf_grayfont_char_range_s *ranges, *range;
+    uint16_t *offsets;
+    uint8_t *boxes, *data;
+    uint32_t header, limit;
+    uint16_t i, used, range_count;
+
+    newfont->font = *basefont;
+    newfont->basefont = basefont;
+
+    newfont->font.character_width = &ram_character_width;
+    newfont->font.render_character = &ram_render_character;
+    newfont->font.render_rows = basefont->render_rows ? &ram_render_rows : 0;
+
+    newfont->subset.font = *basefont;
+    newfont->subset.version = 1;
+    newfont->subset.bits_per_pixel = 4;
+    newfont->subset.char_range_count = 0;
+    newfont->subset.char_ranges = 0;
+    newfont->subset.range_map = 0;
+
+    /* Each run of consecutive characters becomes a character range. */
+    range_count = 0;
+    for (i = 0; i < char_count; i++)
+    {
+        if (i > 0 && (uint16_t)chars[i] <= (uint16_t)chars[i - 1])
+            return 0;
+
+        if (i == 0 || (uint16_t)chars[i] != (uint16_t)chars[i - 1] + 1)
+            range_count++;
+    }
+
+    if (range_count > 255)
+        return 0;
+
+    /* The character ranges come first, then the tables of offsets and
+     * boxes, and then the glyph data. The ranges share the tables. */
+    header = (uint32_t)range_count * sizeof(struct mf_grayfont_char_range_s) +
+             (uint32_t)(char_count + 1) * 2 + (uint32_t)char_count * 4;
+    if (!buffer || size < header)
+        return 0;
+
+    ranges = buffer;
+    offsets = (uint16_t*)(ranges + range_count);
+    boxes = (uint8_t*)(offsets + char_count + 1);
+    data = boxes + (uint32_t)char_count * 4;
+
+    limit = size - header;
+    if (limit > 0xFFFF)
+        limit = 0xFFFF;
+
+    used = 0;
+    range = 0;
+    for (i = 0; i < char_count; i++)
+    {
+        if (!range || (uint16_t)chars[i] != (uint16_t)chars[i - 1] + 1)
+        {
+            range = range ? range + 1 : ranges;
+            range->first_char = (uint16_t)chars[i];
+            range->char_count = 0;
+            range->glyph_offsets = offsets + i;
+            range->glyph_boxes = boxes + (uint32_t)i * 4;
+            range->glyph_data = data;
+        }
+
+        range->char_count++;
+        offsets[i] = used;
+        used += transcode_glyph(basefont, chars[i], boxes + (uint32_t)i * 4,
+                                data + used, limit - used);
+    }
+    offsets[char_count] = used;
+
+    newfont->subset.char_range_count = range_count;
+    newfont->subset.char_ranges = ranges;
+
+    return header + used;
+}
@@ -0,0 +1,51 @@
+/* Fonts with a subset of the characters expanded into RAM. The glyphs of
+ * the subset, e.g. the digits and symbols of a status display, are decoded
+ * once from the base font, e.g. a compressed rlefont in flash, and stored
+ * uncompressed in the grayfont format. After that they render as fast as a
+ * grayfont, while the rest of the characters are still rendered from the
+ * base font.
+ */
+
+#ifndef _MF_RAMFONT_H_
+#define _MF_RAMFONT_H_
+
+#include "mf_font.h"
+#include "mf_grayfont.h"
+
+struct mf_ramfont_s
+{
+    struct mf_font_s font;
+
+    const struct mf_font_s *basefont;
+
+    /* The characters that are stored in RAM, with 16 gray levels. The
+     * character ranges are stored in the buffer, with the glyphs. */
+    struct mf_grayfont_s subset;
+};
+
+/* Create a font that renders the given characters from RAM. The glyphs
+ * are decoded from the base font into the buffer, which must stay
+ * allocated for as long as the new font is used. Characters that do not
+ * fit in the buffer or in the 64 kB that the grayfont format allows are
+ * rendered from the base font.
+ *
+ * Each run of consecutive characters in the list takes a character range
+ * of 12 to 16 bytes in the buffer, and there can be at most 255 runs.
+ *
+ * newfont:    Font structure to fill in.
+ * basefont:   Font to take the glyphs and metrics from.
+ * chars:      The characters to store in RAM, in increasing order.
+ * char_count: Number of characters in the list.
+ * buffer:     Memory for the glyphs, aligned for pointers, e.g. from
+ *             malloc().
+ * size:       Size of the buffer in bytes.
+ *
+ * Returns the number of bytes of the buffer that were used, or 0 if the
+ * list is not in increasing order or has too many runs.
+ */
+MF_EXTERN uint32_t mf_transcode_font(struct mf_ramfont_s *newfont,
+                                     const struct mf_font_s *basefont,
+                                     const mf_char *chars, uint16_t char_count,
+                                     void *buffer, uint32_t size);
+
+#endif
@@ -1,3 +1,6 @@
+#ifndef MF_RLEFONT_INTERNALS
+#define MF_RLEFONT_INTERNALS
+#endif
 #include "mf_rlefont.h"
 
 /* Number of reserved codes before the dictionary entries. */
@@ -6,6 +9,14 @@
 /* Special reference to mean "fill with zeros to the end of the glyph" */
 #define REF_FILLZEROS 16
 
+/* Extended references (format version 5). The code and the byte following
+ * it give the index of a dictionary entry that does not fit in the one-byte
+ * codes. */
+#define REF_EXTENDED 17
+#define IS_EXTENDED_REF(code) ((code) >= REF_EXTENDED && (code) < DICT_START)
+#define EXTENDED_REF_INDEX(code, low) \
+    ((uint16_t)((((code) - REF_EXTENDED) << 8) | (low)))
+
 /* RLE codes */
 #define RLE_CODEMASK    0xC0
 #define RLE_VALMASK     0x3F
@@ -22,31 +33,117 @@
 #define DICT_START3BIT  244
 #define DICT_START2BIT  252
 
+/* Get the number of dictionary entries that have one-byte codes. */
+static uint16_t dict_code_count(const struct mf_rlefont_dict_s *dict)
+{
+    if (dict->dict_code_count)
+        return dict->dict_code_count;
+    else if (dict->dict_entry_count > 256 - DICT_START)
+        return 256 - DICT_START;
+    else
+        return dict->dict_entry_count;
+}
+
+/* Find the character range that contains a given character. Uses the
+ * range map if the font has one, otherwise a binary search. */
+static const struct mf_rlefont_char_range_s *find_range(
+    const struct mf_rlefont_s *font, uint16_t character)
+{
+   unsigned low, high, mid;
+   const struct mf_rlefont_char_range_s *range;
+
+   if (font->range_map && character < MF_RANGE_MAP_SIZE)
+   {
+       mid = pgm_read_byte(font->range_map + character);
+       if (mid >= font->char_range_count)
+           return 0;
+
+       return &font->char_ranges[mid];
+   }
+
+   low = 0;
+   high = font->char_range_count;
+   while (low < high)
+   {
+       mid = (low + high) / 2;
+       range = &font->char_ranges[mid];
+
+       if (character < range->first_char)
+           high = mid;
+       else if (character - range->first_char >= range->char_count)
+           low = mid + 1;
+       else
+           return range;
+   }
+
+   return 0;
+}
+
+/* Find a pointer to the data of a character in the given range. */
+static const uint8_t *get_glyph_data(const struct mf_rlefont_char_range_s *range,
+                                     uint16_t character)
+{
+   unsigned index;
+   uint32_t offset;
+
+   index = character - range->first_char;
+   offset = pgm_read_word(range->glyph_offsets + index);
+   if (range->glyph_offset_bases)
+   {
+       offset += pgm_read_dword(range->glyph_offset_bases +
+                                index / MF_RLEFONT_OFFSET_BLOCK_SIZE);
+   }
+
+   return &range->glyph_data[offset];
+}
+
 /* Find a pointer to the glyph matching a given character by searching
  * through the character ranges. If the character is not found, return
- * pointer to the default glyph.
+ * pointer to the default glyph. The range of the glyph is stored to
+ * range_out, if it is not NULL.
  */
 static const uint8_t *find_glyph(const struct mf_rlefont_s *font,
-                                 uint16_t character)
+                                 uint16_t character,
+                                 const struct mf_rlefont_char_range_s **range_out)
 {
-   unsigned i, index;
    const struct mf_rlefont_char_range_s *range;
-   for (i = 0; i < font->char_range_count; i++)
-   {
-       range = &font->char_ranges[i];
-       index = character - range->first_char;
-       if (character >= range->first_char && index < range->char_count)
-       {
-           uint16_t offset = pgm_read_word(range->glyph_offsets + index);
-           return &range->glyph_data[offset];
-       }
-   }
 
-   return 0;
+   range = find_range(font, character);
+   if (!range)
+       return 0;
+
+   if (range_out)
+       *range_out = range;
+   return get_glyph_data(range, character);
+}
+
+/* Get the dictionary used by a character range. Ranges without their own
+ * dictionary use the dictionary of the font, which is copied to fontdict. */
+static const struct mf_rlefont_dict_s *get_dictionary(
+    const struct mf_rlefont_s *font,
+    const struct mf_rlefont_char_range_s *range,
+    struct mf_rlefont_dict_s *fontdict)
+{
+    if (range->dictionary)
+        return range->dictionary;
+
+    fontdict->dictionary_data = font->dictionary_data;
+    fontdict->dictionary_offsets = font->dictionary_offsets;
+    fontdict->rle_entry_count = font->rle_entry_count;
+    fontdict->dict_entry_count = font->dict_entry_count;
+    fontdict->dict_code_count = font->dict_code_count;
+    fontdict->offset_x = 0;
+    fontdict->offset_y = 0;
+    fontdict->width = font->font.width;
+    fontdict->height = font->font.height;
+    return fontdict;
 }
 
 /* Structure to keep track of coordinates of the next pixel to be written,
- * and also the bounds of the character. */
+ * and also the bounds of the character. The run of pixels that has not
+ * yet been passed on is kept in the pending_ fields. Only the rows from
+ * clip_y0 to clip_y1 are passed on, to the framebuffer if fb is set and
+ * otherwise to the callback. */
 struct renderstate_r
 {
     int16_t x_begin;
@@ -54,12 +151,65 @@ struct renderstate_r
     int16_t x;
     int16_t y;
     int16_t y_end;
+    int16_t clip_y0;
+    int16_t clip_y1;
     mf_pixel_callback_t callback;
     void *state;
+    const struct mf_framebuffer_s *fb;
+    int16_t pending_x;
+    int16_t pending_y;
+    uint8_t pending_count;
+    uint8_t pending_alpha;
 };
 
-/* Call the callback to write one pixel to screen, and advance to next
- * pixel position. */
+/* Pass the pending run of pixels to the framebuffer or the callback. */
+static void flush_pixels(struct renderstate_r *rstate)
+{
+    if (!rstate->pending_count)
+        return;
+
+    if (rstate->fb)
+    {
+        mf_framebuffer_write_run(rstate->fb, rstate->pending_x,
+                                 rstate->pending_y, rstate->pending_count,
+                                 rstate->pending_alpha);
+    }
+    else
+    {
+        rstate->callback(rstate->pending_x, rstate->pending_y,
+                         rstate->pending_count, rstate->pending_alpha,
+                         rstate->state);
+    }
+
+    rstate->pending_count = 0;
+}
+
+/* Add a run of pixels on the current row. It is merged with the pending
+ * run if it continues it with the same alpha, because the codewords often
+ * split a single run into several pieces. */
+static void add_pixels(struct renderstate_r *rstate, uint8_t count,
+                       uint8_t alpha)
+{
+    if (rstate->y < rstate->clip_y0 || rstate->y >= rstate->clip_y1)
+        return;
+
+    if (rstate->pending_count &&
+        rstate->pending_y == rstate->y &&
+        rstate->pending_x + rstate->pending_count == rstate->x &&
+        rstate->pending_alpha == alpha)
+    {
+        rstate->pending_count += count;
+        return;
+    }
+
+    flush_pixels(rstate);
+    rstate->pending_x = rstate->x;
+    rstate->pending_y = rstate->y;
+    rstate->pending_count = count;
+    rstate->pending_alpha = alpha;
+}
+
+/* Write out a run of pixels, and advance to next pixel position. */
 static void write_pixels(struct renderstate_r *rstate, uint16_t count,
                          uint8_t alpha)
 {
@@ -69,7 +219,7 @@ static void write_pixels(struct renderstate_r *rstate, uint16_t count,
     while ((int32_t)rstate->x + count >= rstate->x_end)
     {
         rowlen = rstate->x_end - rstate->x;
-        rstate->callback(rstate->x, rstate->y, rowlen, alpha, rstate->state);
+        add_pixels(rstate, rowlen, alpha);
         count -= rowlen;
         rstate->x = rstate->x_begin;
         rstate->y++;
@@ -78,7 +228,7 @@ static void write_pixels(struct renderstate_r *rstate, uint16_t count,
     /* Write the remaining part */
     if (count)
     {
-        rstate->callback(rstate->x, rstate->y, count, alpha, rstate->state);
+        add_pixels(rstate, count, alpha);
         rstate->x += count;
     }
 }
@@ -95,17 +245,17 @@ static void skip_pixels(struct renderstate_r *rstate, uint16_t count)
 }
 
 /* Decode and write out a RLE-encoded dictionary entry. */
-static void write_rle_dictentry(const struct mf_rlefont_s *font,
+static void write_rle_dictentry(const struct mf_rlefont_dict_s *dict,
                                 struct renderstate_r *rstate,
-                                uint8_t index)
+                                uint16_t index)
 {
-    uint16_t offset = pgm_read_word(font->dictionary_offsets + index);
-    uint16_t length = pgm_read_word(font->dictionary_offsets + index + 1) - offset;
+    uint16_t offset = pgm_read_word(dict->dictionary_offsets + index);
+    uint16_t length = pgm_read_word(dict->dictionary_offsets + index + 1) - offset;
     uint16_t i;
 
     for (i = 0; i < length; i++)
     {
-        uint8_t code = pgm_read_byte(font->dictionary_data + offset + i);
+        uint8_t code = pgm_read_byte(dict->dictionary_data + offset + i);
         if ((code & RLE_CODEMASK) == RLE_ZEROS)
         {
             skip_pixels(rstate, code & RLE_VALMASK);
@@ -128,6 +278,81 @@ static void write_rle_dictentry(const struct mf_rlefont_s *font,
     }
 }
 
+#if MF_USE_DECODE_TABLES
+
+/* Runs of pixels for each of the codes from DICT_START up, when the code
+ * is used as a fill entry. The lowest 4 bits give the number of runs, and
+ * each following group of 3 bits the length of a run. The runs alternate
+ * between skipped and filled pixels, starting with skipped. */
+static const uint32_t fill_runs[256 - DICT_START] PROGMEM = {
+    0x00224a5, 0x0892487, 0x0022515, 0x0022585, 0x0000933, 0x0024885,
+    0x0024495, 0x0024505, 0x00009a3, 0x0026485, 0x0000a13, 0x0000a83,
+    0x00004d3, 0x0013085, 0x0012c95, 0x0012d05, 0x00128a5, 0x04a2487,
+    0x0012915, 0x0012985, 0x00124b5, 0x0492887, 0x0492497, 0x0492507,
+    0x0012525, 0x0494487, 0x0012595, 0x0012605, 0x0000543, 0x0014c85,
+    0x0014895, 0x0014905, 0x00144a5, 0x0512487, 0x0014515, 0x0014585,
+    0x00005b3, 0x0016885, 0x0016495, 0x0016505, 0x0000623, 0x0018485,
+    0x0000693, 0x0000703, 0x00000e2, 0x0003484, 0x0003094, 0x0003104,
+    0x0002ca4, 0x00b2486, 0x0002d14, 0x0002d84, 0x00028b4, 0x00a2886,
+    0x00a2496, 0x00a2506, 0x0002924, 0x00a4486, 0x0002994, 0x0002a04,
+    0x00024c4, 0x0092c86, 0x0092896, 0x0092906, 0x00924a6, 0x2492488,
+    0x0092516, 0x0092586, 0x0002534, 0x0094886, 0x0094496, 0x0094506,
+    0x00025a4, 0x0096486, 0x0002614, 0x0002684, 0x0000152, 0x0005084,
+    0x0004c94, 0x0004d04, 0x00048a4, 0x0122486, 0x0004914, 0x0004984,
+    0x00044b4, 0x0112886, 0x0112496, 0x0112506, 0x0004524, 0x0114486,
+    0x0004594, 0x0004604, 0x00001c2, 0x0006c84, 0x0006894, 0x0006904,
+    0x00064a4, 0x0192486, 0x0006514, 0x0006584, 0x0000232, 0x0008884,
+    0x0008494, 0x0008504, 0x00002a2, 0x000a484, 0x0000312, 0x0000382,
+    0x0000061, 0x0001483, 0x0001093, 0x0001103, 0x0000ca3, 0x0032485,
+    0x0000d13, 0x0000d83, 0x00008b3, 0x0022885, 0x0022495, 0x0022505,
+    0x0000923, 0x0024485, 0x0000993, 0x0000a03, 0x00004c3, 0x0012c85,
+    0x0012895, 0x0012905, 0x00124a5, 0x0492487, 0x0012515, 0x0012585,
+    0x0000533, 0x0014885, 0x0014495, 0x0014505, 0x00005a3, 0x0016485,
+    0x0000613, 0x0000683, 0x00000d2, 0x0003084, 0x0002c94, 0x0002d04,
+    0x00028a4, 0x00a2486, 0x0002914, 0x0002984, 0x00024b4, 0x0092886,
+    0x0092496, 0x0092506, 0x0002524, 0x0094486, 0x0002594, 0x0002604,
+    0x0000142, 0x0004c84, 0x0004894, 0x0004904, 0x00044a4, 0x0112486,
+    0x0004514, 0x0004584, 0x00001b2, 0x0006884, 0x0006494, 0x0006504,
+    0x0000222, 0x0008484, 0x0000292, 0x0000302, 0x0000051, 0x0001083,
+    0x0000c93, 0x0000d03, 0x00008a3, 0x0022485, 0x0000913, 0x0000983,
+    0x00004b3, 0x0012885, 0x0012495, 0x0012505, 0x0000523, 0x0014485,
+    0x0000593, 0x0000603, 0x00000c2, 0x0002c84, 0x0002894, 0x0002904,
+    0x00024a4, 0x0092486, 0x0002514, 0x0002584, 0x0000132, 0x0004884,
+    0x0004494, 0x0004504, 0x00001a2, 0x0006484, 0x0000212, 0x0000282,
+    0x0000041, 0x0000c83, 0x0000893, 0x0000903, 0x00004a3, 0x0012485,
+    0x0000513, 0x0000583, 0x00000b2, 0x0002884, 0x0002494, 0x0002504,
+    0x0000122, 0x0004484, 0x0000192, 0x0000202, 0x0000031, 0x0000883,
+    0x0000493, 0x0000503, 0x00000a2, 0x0002484, 0x0000112, 0x0000182,
+    0x0000021, 0x0000483, 0x0000092, 0x0000102,
+};
+
+/* Decode and write out a direct binary codeword */
+static void write_bin_codeword(const struct mf_rlefont_dict_s *dict,
+                                struct renderstate_r *rstate,
+                                uint8_t code)
+{
+    (void)dict;
+    uint32_t runs = pgm_read_dword(fill_runs + (code - DICT_START));
+    uint8_t count = runs & 0x0F;
+    uint8_t runlen, fill = 0;
+
+    runs >>= 4;
+    while (count--)
+    {
+        runlen = runs & 0x07;
+        runs >>= 3;
+
+        if (fill)
+            write_pixels(rstate, runlen, 255);
+        else if (runlen)
+            skip_pixels(rstate, runlen);
+
+        fill = !fill;
+    }
+}
+
+#else
+
 /* Get bit count for the "fill entries" */
 static uint8_t fillentry_bitcount(uint8_t index)
 {
@@ -146,11 +371,11 @@ static uint8_t fillentry_bitcount(uint8_t index)
 }
 
 /* Decode and write out a direct binary codeword */
-static void write_bin_codeword(const struct mf_rlefont_s *font,
+static void write_bin_codeword(const struct mf_rlefont_dict_s *dict,
                                 struct renderstate_r *rstate,
                                 uint8_t code)
 {
-    (void)font;
+    (void)dict;
     uint8_t bitcount = fillentry_bitcount(code);
     uint8_t byte = code - DICT_START7BIT;
     uint8_t runlen = 0;
@@ -179,8 +404,10 @@ static void write_bin_codeword(const struct mf_rlefont_s *font,
         write_pixels(rstate, runlen, 255);
 }
 
+#endif
+
 /* Decode and write out a reference codeword */
-static void write_ref_codeword(const struct mf_rlefont_s *font,
+static void write_ref_codeword(const struct mf_rlefont_dict_s *dict,
                                 struct renderstate_r *rstate,
                                 uint8_t code)
 {
@@ -201,87 +428,314 @@ static void write_ref_codeword(const struct mf_rlefont_s *font,
     {
         /* Reserved */
     }
-    else if (code < DICT_START + font->rle_entry_count)
+    else if (code >= DICT_START + dict_code_count(dict))
     {
-        write_rle_dictentry(font, rstate, code - DICT_START);
+        write_bin_codeword(dict, rstate, code);
     }
-    else
+    else if (code < DICT_START + dict->rle_entry_count)
     {
-        write_bin_codeword(font, rstate, code);
+        write_rle_dictentry(dict, rstate, code - DICT_START);
     }
 }
 
 /* Decode and write out a reference encoded dictionary entry. */
-static void write_ref_dictentry(const struct mf_rlefont_s *font,
+static void write_ref_dictentry(const struct mf_rlefont_dict_s *dict,
                                 struct renderstate_r *rstate,
-                                uint8_t index)
+                                uint16_t index)
 {
-    uint16_t offset = pgm_read_word(font->dictionary_offsets + index);
-    uint16_t length = pgm_read_word(font->dictionary_offsets + index + 1) - offset;
+    uint16_t offset = pgm_read_word(dict->dictionary_offsets + index);
+    uint16_t length = pgm_read_word(dict->dictionary_offsets + index + 1) - offset;
     uint16_t i;
 
     for (i = 0; i < length; i++)
     {
-        uint8_t code = pgm_read_byte(font->dictionary_data + offset + i);
-        write_ref_codeword(font, rstate, code);
+        uint8_t code = pgm_read_byte(dict->dictionary_data + offset + i);
+
+        if (IS_EXTENDED_REF(code))
+        {
+            /* Reference encoded entries can only refer to RLE entries. */
+            uint8_t low = pgm_read_byte(dict->dictionary_data + offset + (++i));
+            uint16_t entry = EXTENDED_REF_INDEX(code, low);
+
+            if (entry < dict->rle_entry_count)
+                write_rle_dictentry(dict, rstate, entry);
+        }
+        else
+        {
+            write_ref_codeword(dict, rstate, code);
+        }
     }
 }
 
+/* Decode and write out an extended reference to a dictionary entry. */
+static void write_extended_codeword(const struct mf_rlefont_dict_s *dict,
+                                    struct renderstate_r *rstate,
+                                    uint16_t index)
+{
+    if (index < dict->rle_entry_count)
+        write_rle_dictentry(dict, rstate, index);
+    else if (index < dict->dict_entry_count)
+        write_ref_dictentry(dict, rstate, index);
+}
+
 /* Decode and write out an arbitrary glyph codeword */
-static void write_glyph_codeword(const struct mf_rlefont_s *font,
+#if MF_USE_DECODE_TABLES
+static void write_glyph_codeword(const struct mf_rlefont_dict_s *dict,
                                 struct renderstate_r *rstate,
                                 uint8_t code)
 {
-    if (code >= DICT_START + font->rle_entry_count &&
-        code < DICT_START + font->dict_entry_count)
+    uint16_t index;
+
+    /* The most common codes first. Where the fill entries begin depends
+     * on the font, so that takes a comparison instead of a table. */
+    if (code >= DICT_START)
     {
-        write_ref_dictentry(font, rstate, code - DICT_START);
+        index = code - DICT_START;
+
+        if (index >= dict_code_count(dict))
+            write_bin_codeword(dict, rstate, code);
+        else if (index < dict->rle_entry_count)
+            write_rle_dictentry(dict, rstate, index);
+        else
+            write_ref_dictentry(dict, rstate, index);
     }
     else
     {
-        write_ref_codeword(font, rstate, code);
+        write_ref_codeword(dict, rstate, code);
     }
 }
+#else
+static void write_glyph_codeword(const struct mf_rlefont_dict_s *dict,
+                                struct renderstate_r *rstate,
+                                uint8_t code)
+{
+    if (code >= DICT_START + dict->rle_entry_count &&
+        code < DICT_START + dict_code_count(dict))
+    {
+        write_ref_dictentry(dict, rstate, code - DICT_START);
+    }
+    else
+    {
+        write_ref_codeword(dict, rstate, code);
+    }
+}
+#endif
 
 
-uint8_t mf_rlefont_render_character(const struct mf_font_s *font,
-                                    int16_t x0, int16_t y0,
-                                    uint16_t character,
-                                    mf_pixel_callback_t callback,
-                                    void *state)
+/* Read a 16-bit little endian value from the glyph data. */
+static uint16_t read_le16(const uint8_t *p)
 {
-    const uint8_t *p;
-    uint8_t width;
+    return pgm_read_byte(p) | ((uint16_t)pgm_read_byte(p + 1) << 8);
+}
+
+/* Skip the row checkpoints at the start of the glyph codewords. If the
+ * first rows of the glyph are clipped, move to the last checkpoint before
+ * the clip region. Returns the pointer to the codeword to decode next. */
+static const uint8_t *seek_checkpoint(const struct mf_rlefont_char_range_s *range,
+                                      struct renderstate_r *rstate,
+                                      const uint8_t *p)
+{
+    const uint8_t *checkpoint;
+    uint8_t interval = range->row_checkpoint_interval;
+    uint8_t boxwidth = rstate->x_end - rstate->x_begin;
+    uint16_t count, index, pixel;
+
+    if (!interval || rstate->y_end <= rstate->y || !boxwidth)
+        return p;
+
+    count = (rstate->y_end - rstate->y - 1) / interval;
 
+    index = 0;
+    if (rstate->clip_y0 > rstate->y)
+        index = (rstate->clip_y0 - rstate->y) / interval;
+    if (index > count)
+        index = count;
+
+    if (index == 0)
+        return p + count * 4;
+
+    checkpoint = p + (index - 1) * 4;
+    pixel = read_le16(checkpoint + 2);
+    rstate->x += pixel % boxwidth;
+    rstate->y += pixel / boxwidth;
+    return p + count * 4 + read_le16(checkpoint);
+}
+
+/* Get the index of the next pixel to write within the glyph box. */
+static uint16_t get_pixel_index(const struct renderstate_r *rstate,
+                                int16_t y_begin)
+{
+    uint8_t boxwidth = rstate->x_end - rstate->x_begin;
+    return (uint16_t)(rstate->y - y_begin) * boxwidth +
+           (rstate->x - rstate->x_begin);
+}
+
+/* Continue from the resume point stored by the previous call, if it is
+ * further than the checkpoint and does not skip any rows inside the clip.
+ * Returns the pointer to the codeword to decode next. */
+static const uint8_t *seek_resume(const struct mf_resume_s *resume,
+                                  struct renderstate_r *rstate,
+                                  int16_t y_begin,
+                                  const uint8_t *glyph,
+                                  const uint8_t *p)
+{
+    uint8_t boxwidth = rstate->x_end - rstate->x_begin;
+
+    if (!resume || !resume->offset || !boxwidth)
+        return p;
+
+    if (y_begin + resume->pixel / boxwidth > rstate->clip_y0 ||
+        resume->pixel <= get_pixel_index(rstate, y_begin))
+        return p;
+
+    rstate->x = rstate->x_begin + resume->pixel % boxwidth;
+    rstate->y = y_begin + resume->pixel / boxwidth;
+    return glyph + resume->offset;
+}
+
+/* Render the rows from clip_y0 to clip_y1 of a glyph, to the framebuffer
+ * if fb is not NULL and otherwise to the callback. */
+static uint8_t render_rows(const struct mf_font_s *font,
+                           int16_t x0, int16_t y0,
+                           uint16_t character,
+                           int16_t clip_y0, int16_t clip_y1,
+                           struct mf_resume_s *resume,
+                           mf_pixel_callback_t callback,
+                           void *state,
+                           const struct mf_framebuffer_s *fb)
+{
+    const uint8_t *glyph, *p, *box, *last;
+    uint8_t width, code;
+    int16_t y_begin, last_x, last_y;
+    const struct mf_rlefont_char_range_s *range;
+    const struct mf_rlefont_dict_s *dict;
+    struct mf_rlefont_dict_s fontdict;
     struct renderstate_r rstate;
-    rstate.x_begin = x0;
-    rstate.x_end = x0 + font->width;
-    rstate.x = x0;
-    rstate.y = y0;
-    rstate.y_end = y0 + font->height;
+
+    glyph = find_glyph((struct mf_rlefont_s*)font, character, &range);
+    if (!glyph)
+        return 0;
+
+    dict = get_dictionary((struct mf_rlefont_s*)font, range, &fontdict);
+
+    rstate.x_begin = x0 + dict->offset_x;
+    rstate.x_end = rstate.x_begin + dict->width;
+    rstate.x = rstate.x_begin;
+    rstate.y = y0 + dict->offset_y;
+    rstate.y_end = rstate.y + dict->height;
+
+    /* Cropped glyphs only cover their own box. */
+    if (range->glyph_boxes)
+    {
+        box = range->glyph_boxes + (uint32_t)(character - range->first_char) * 4;
+        rstate.x_begin += pgm_read_byte(box);
+        rstate.x_end = rstate.x_begin + pgm_read_byte(box + 2);
+        rstate.x = rstate.x_begin;
+        rstate.y += pgm_read_byte(box + 1);
+        rstate.y_end = rstate.y + pgm_read_byte(box + 3);
+    }
+
+    rstate.clip_y0 = clip_y0;
+    rstate.clip_y1 = clip_y1;
     rstate.callback = callback;
     rstate.state = state;
+    rstate.fb = fb;
+    rstate.pending_count = 0;
 
-    p = find_glyph((struct mf_rlefont_s*)font, character);
-    if (!p)
-        return 0;
+    y_begin = rstate.y;
+    width = pgm_read_byte(glyph);
+    p = seek_checkpoint(range, &rstate, glyph + 1);
+    p = seek_resume(resume, &rstate, y_begin, glyph, p);
+
+    last = 0;
+    last_x = rstate.x;
+    last_y = rstate.y;
+
+    while (rstate.y < rstate.y_end && rstate.y < clip_y1)
+    {
+        last = p;
+        last_x = rstate.x;
+        last_y = rstate.y;
+        code = pgm_read_byte(p++);
+
+        if (IS_EXTENDED_REF(code))
+        {
+            uint16_t index = EXTENDED_REF_INDEX(code, pgm_read_byte(p));
+            p++;
+            write_extended_codeword(dict, &rstate, index);
+        }
+        else
+        {
+            write_glyph_codeword(dict, &rstate, code);
+        }
+    }
 
-    width = pgm_read_byte(p++);
-    while (rstate.y < rstate.y_end)
+    flush_pixels(&rstate);
+
+    /* The next call can continue from the next codeword if the last one
+     * ended exactly at clip_y1. Otherwise the last one wrote pixels that
+     * were clipped away, and it has to be decoded again. */
+    if (resume && last)
     {
-        write_glyph_codeword((struct mf_rlefont_s*)font, &rstate, pgm_read_byte(p++));
+        if (rstate.y == clip_y1 && rstate.x == rstate.x_begin &&
+            rstate.y < rstate.y_end)
+        {
+            last = p;
+            last_x = rstate.x;
+            last_y = rstate.y;
+        }
+
+        rstate.x = last_x;
+        rstate.y = last_y;
+        resume->offset = last - glyph;
+        resume->pixel = get_pixel_index(&rstate, y_begin);
     }
 
     return width;
 }
 
+uint8_t mf_rlefont_render_rows(const struct mf_font_s *font,
+                               int16_t x0, int16_t y0,
+                               uint16_t character,
+                               int16_t clip_y0, int16_t clip_y1,
+                               struct mf_resume_s *resume,
+                               mf_pixel_callback_t callback,
+                               void *state)
+{
+    return render_rows(font, x0, y0, character, clip_y0, clip_y1, resume,
+                       callback, state, 0);
+}
+
+uint8_t mf_rlefont_render_framebuffer(const struct mf_font_s *font,
+                                      int16_t x0, int16_t y0,
+                                      uint16_t character,
+                                      const struct mf_framebuffer_s *fb)
+{
+    return render_rows(font, x0, y0, character, fb->clip_y0, fb->clip_y1, 0,
+                       0, 0, fb);
+}
+
+uint8_t mf_rlefont_render_character(const struct mf_font_s *font,
+                                    int16_t x0, int16_t y0,
+                                    uint16_t character,
+                                    mf_pixel_callback_t callback,
+                                    void *state)
+{
+    return mf_rlefont_render_rows(font, x0, y0, character, INT16_MIN,
+                                  INT16_MAX, 0, callback, state);
+}
+
 uint8_t mf_rlefont_character_width(const struct mf_font_s *font,
                                    uint16_t character)
 {
-    const uint8_t *p;
-    p = find_glyph((struct mf_rlefont_s*)font, character);
-    if (!p)
+    const struct mf_rlefont_char_range_s *range;
+    range = find_range((struct mf_rlefont_s*)font, character);
+    if (!range)
         return 0;
 
-    return pgm_read_byte(p);
+    /* The width table avoids reading the scattered glyph data. */
+    if (range->glyph_widths)
+        return pgm_read_byte(range->glyph_widths + (character - range->first_char));
+
+    return pgm_read_byte(get_glyph_data(range, character));
 }
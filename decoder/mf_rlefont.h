@@ -6,9 +6,36 @@
 #define _MF_RLEFONT_H_
 
 #include "mf_font.h"
+#include "mf_framebuffer.h"
 
 /* Versions of the RLE font format that are supported. */
 #define MF_RLEFONT_VERSION_4_SUPPORTED 1
+#define MF_RLEFONT_VERSION_5_SUPPORTED 1
+
+/* Number of glyphs that share one entry in glyph_offset_bases. */
+#define MF_RLEFONT_OFFSET_BLOCK_SIZE 64
+
+/* Dictionary used by a group of character ranges (format version 5).
+ * This allows e.g. Latin and CJK characters to have separate dictionaries,
+ * each optimized for the glyphs of that script. The glyphs using the
+ * dictionary may also have a smaller box than the font. */
+struct mf_rlefont_dict_s
+{
+    /* Dictionary tables, same as in struct mf_rlefont_s. */
+    const uint8_t *dictionary_data;
+    const uint16_t *dictionary_offsets;
+    uint16_t rle_entry_count;
+    uint16_t dict_entry_count;
+    uint8_t dict_code_count;
+
+    /* Location of the glyph box relative to the font box. */
+    uint8_t offset_x;
+    uint8_t offset_y;
+
+    /* Width and height of the glyph box. */
+    uint8_t width;
+    uint8_t height;
+};
 
 /* Structure for a range of characters. This implements a sparse storage of
  * character indices, so that you can e.g. pick a 100 characters in the middle
@@ -26,6 +53,35 @@ struct mf_rlefont_char_range_s
 
     /* The encoded glyph data for glyphs in this range. */
     const uint8_t *glyph_data;
+
+    /* Dictionary for the glyphs in this range, or NULL to use the
+     * dictionary of the font. Added in version 5. */
+    const struct mf_rlefont_dict_s *dictionary;
+
+    /* Base offsets for each block of MF_RLEFONT_OFFSET_BLOCK_SIZE glyphs, or
+     * NULL. If present, the glyph offsets are relative to the base of their
+     * block, which allows ranges larger than 64 kB. Added in version 5. */
+    const uint32_t *glyph_offset_bases;
+
+    /* Widths of the glyphs in this range, or NULL. Allows measuring text
+     * without reading the glyph data. Added in version 5. */
+    const uint8_t *glyph_widths;
+
+    /* Boxes of the glyphs in this range, or NULL if the glyphs cover the
+     * whole glyph box of the font. Each box is given as 4 bytes: x and y
+     * offset from the top left corner, width and height. The glyph data
+     * then only encodes the pixels inside the box. Added in version 5. */
+    const uint8_t *glyph_boxes;
+
+    /* Interval in rows of the checkpoints stored with the glyphs, or 0 if
+     * there are none. If nonzero, the width byte of each glyph is followed
+     * by (height - 1) / interval checkpoints, one for every interval rows
+     * of the glyph box. Each checkpoint has two 16-bit little endian values:
+     * the offset of a codeword from the end of the checkpoints, and the
+     * index of the pixel where the codeword starts. The codeword is the last
+     * one that starts at or before the first pixel of the row. This allows
+     * rendering only some of the rows of tall glyphs. Added in version 5. */
+    uint8_t row_checkpoint_interval;
 };
 
 /* Structure for a single encoded font. */
@@ -34,9 +90,11 @@ struct mf_rlefont_s
     struct mf_font_s font;
 
     /* Version of the font definition used. */
-    const uint8_t version;
+    uint8_t version;
 
-    /* Big array of the data for all the dictionary entries. */
+    /* Big array of the data for all the dictionary entries.
+     * Several fonts can point to the same dictionary tables, see the
+     * rlefont_export_shared command of the encoder. */
     const uint8_t *dictionary_data;
 
     /* Lookup table with the start indices into dictionary_data.
@@ -46,21 +104,39 @@ struct mf_rlefont_s
 
     /* Number of dictionary entries using the RLE encoding.
      * Entries starting at this index use the dictionary encoding. */
-    const uint8_t rle_entry_count;
+    uint16_t rle_entry_count;
 
     /* Total number of dictionary entries.
-     * Entries after this are nonexistent. */
-    const uint8_t dict_entry_count;
+     * Entries after this are nonexistent. Version 4 fonts have at most 232
+     * entries. Version 5 fonts can have up to 1792 entries; the entries past
+     * the one-byte codes are referred to with two-byte extended codes. */
+    uint16_t dict_entry_count;
 
     /* Number of discontinuous character ranges */
-    const uint8_t char_range_count;
+    uint8_t char_range_count;
 
-    /* Array of the character ranges */
+    /* Array of the character ranges, sorted by first_char. */
     const struct mf_rlefont_char_range_s *char_ranges;
+
+    /* The fields below were added in version 5. They are left out from
+     * version 4 fonts, and are then zero. */
+
+    /* Number of dictionary entries that have one-byte codes. The one-byte
+     * codes after them are used for the binary fill entries. The encoder
+     * selects the split that gives the smallest font. If zero, the entries
+     * take as many codes as they need, up to the 232 available. */
+    uint8_t dict_code_count;
+
+    /* Table of MF_RANGE_MAP_SIZE entries that maps the first characters
+     * directly to their character range, or NULL. */
+    const uint8_t *range_map;
 };
 
 #ifdef MF_RLEFONT_INTERNALS
-/* Internal functions, don't use these directly. */
+/* Internal functions, don't use these directly. They are only declared for
+ * the font definitions and the other decoder modules, which define
+ * MF_RLEFONT_INTERNALS. Applications reach them through the function
+ * pointers of mf_font_s and through mf_framebuffer_render_character(). */
 MF_EXTERN uint8_t mf_rlefont_render_character(const struct mf_font_s *font,
                                               int16_t x0, int16_t y0,
                                               mf_char character,
@@ -69,6 +145,26 @@ MF_EXTERN uint8_t mf_rlefont_render_character(const struct mf_font_s *font,
 
 MF_EXTERN uint8_t mf_rlefont_character_width(const struct mf_font_s *font,
                                              mf_char character);
+
+/* The render_rows function of rlefonts. Renders only the rows from clip_y0
+ * up to, but not including, clip_y1. Decoding starts from the row
+ * checkpoint closest to clip_y0, if the font has them, or from the resume
+ * point if that is closer. It stops after clip_y1, and the start of the
+ * last codeword is stored as the new resume point. */
+MF_EXTERN uint8_t mf_rlefont_render_rows(const struct mf_font_s *font,
+                                         int16_t x0, int16_t y0,
+                                         mf_char character,
+                                         int16_t clip_y0, int16_t clip_y1,
+                                         struct mf_resume_s *resume,
+                                         mf_pixel_callback_t callback,
+                                         void *state);
+
+/* Used by mf_framebuffer_render_character(). Renders a character straight
+ * into a framebuffer, only the rows inside its clip rectangle. */
+MF_EXTERN uint8_t mf_rlefont_render_framebuffer(const struct mf_font_s *font,
+                                                int16_t x0, int16_t y0,
+                                                mf_char character,
+                                                const struct mf_framebuffer_s *fb);
 #endif
 
 #endif
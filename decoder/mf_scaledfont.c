@@ -76,6 +76,9 @@ void mf_scale_font(struct mf_scaledfont_s *newfont,
     newfont->font.line_height *= y_scale;
     newfont->font.character_width = &scaled_character_width;
     newfont->font.render_character = &scaled_render_character;
+    newfont->font.kerning = 0;
+    newfont->font.ink_boxes = 0;
+    newfont->font.render_rows = 0;
 
     newfont->x_scale = x_scale;
     newfont->y_scale = y_scale;
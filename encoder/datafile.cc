@@ -33,6 +33,9 @@ void DataFile::Save(std::ostream &file) const
     file << "Flags " << m_fontinfo.flags << std::endl;
     file << "RandomSeed " << m_seed << std::endl;
 
+    if (m_dictionary.size() != dictionarysize)
+        file << "DictionarySize " << m_dictionary.size() << std::endl;
+
     for (const dictentry_t &d : m_dictionary)
     {
         if (d.replacement.size() != 0)
@@ -60,6 +63,7 @@ std::unique_ptr<DataFile> DataFile::Load(std::istream &file)
     std::vector<dictentry_t> dictionary;
     std::vector<glyphentry_t> glyphtable;
     uint32_t seed = 1234;
+    size_t dictsize = dictionarysize;
     int version = -1;
 
     std::string line;
@@ -107,7 +111,14 @@ std::unique_ptr<DataFile> DataFile::Load(std::istream &file)
         {
             input >> fontinfo.flags;
         }
-        else if (tag == "DictEntry" && dictionary.size() < dictionarysize)
+        else if (tag == "DictionarySize")
+        {
+            input >> dictsize;
+
+            if (dictsize < dictionarysize || dictsize > maxdictionarysize)
+                throw std::runtime_error("invalid dictionary size: " + std::to_string(dictsize));
+        }
+        else if (tag == "DictEntry" && dictionary.size() < dictsize)
         {
             dictentry_t d = {};
             input >> d.score >> d.ref_encode >> d.replacement;
@@ -138,6 +149,9 @@ std::unique_ptr<DataFile> DataFile::Load(std::istream &file)
         return std::unique_ptr<DataFile>(nullptr);
     }
 
+    dictentry_t dummy = {};
+    dictionary.resize(dictsize, dummy);
+
     std::unique_ptr<DataFile> result(new DataFile(dictionary, glyphtable, fontinfo));
     result->SetSeed(seed);
     return result;
@@ -154,6 +168,16 @@ void DataFile::SetDictionaryEntry(size_t index, const dictentry_t &value)
     }
 }
 
+void DataFile::SetDictionarySize(size_t size)
+{
+    if (size < dictionarysize || size > maxdictionarysize)
+        throw std::out_of_range("invalid dictionary size: " + std::to_string(size));
+
+    dictentry_t dummy = {};
+    m_dictionary.resize(size, dummy);
+    UpdateLowScoreIndex();
+}
+
 std::map<size_t, size_t> DataFile::GetCharToGlyphMap() const
 {
     std::map<size_t, size_t> char_to_glyph;
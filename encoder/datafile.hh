@@ -61,12 +61,22 @@ public:
     // Returns nullptr if load fails.
     static std::unique_ptr<DataFile> Load(std::istream &file);
 
-    // Get or set an entry in the dictionary. The size of the dictionary
-    // is constant. Entries 0 to 23 are reserved for special purposes.
+    // Get or set an entry in the dictionary. By default the dictionary
+    // has one entry for each one-byte code; codes 0 to 23 are reserved for
+    // special purposes. The dictionary can be enlarged up to
+    // maxdictionarysize entries, the rest are reached through two-byte
+    // extended codes.
     static const size_t dictionarysize = 256 - 24;
+    static const size_t maxdictionarysize = 7 * 256;
     const dictentry_t &GetDictionaryEntry(size_t index) const
         { return m_dictionary.at(index); }
     void SetDictionaryEntry(size_t index, const dictentry_t &value);
+
+    // Get or change the number of entries in the dictionary. When the
+    // dictionary is shrunk, the entries at the end are dropped.
+    size_t GetDictionarySize() const
+        { return m_dictionary.size(); }
+    void SetDictionarySize(size_t size);
     const std::vector<dictentry_t> &GetDictionary() const
         { return m_dictionary; }
 
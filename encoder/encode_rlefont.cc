@@ -9,6 +9,15 @@
 // Special reference to mean "fill with zeros to the end of the glyph"
 #define REF_FILLZEROS 16
 
+// Extended references: the code and the following byte together give the
+// index of the dictionary entry, for entries past the one-byte codes.
+#define REF_EXTENDED    17
+#define REF_EXTENDED_COUNT 7
+
+// Dictionary references in the tree at or above this value are stored
+// as extended references.
+#define EXTENDED_REF_BASE 256
+
 // RLE codes
 #define RLE_CODEMASK    0xC0
 #define RLE_VALMASK     0x3F
@@ -45,6 +54,45 @@ static size_t fillentry_bitcount(size_t index)
         return 7;
 }
 
+// Number of dictionary entries that fit in the one-byte codes.
+static size_t get_onebyte_count(size_t dict_count)
+{
+    return std::min<size_t>(dict_count, 256 - DICT_START);
+}
+
+// Count the non-empty entries in the dictionary.
+static size_t get_dict_count(const std::vector<DataFile::dictentry_t> &dictionary)
+{
+    size_t count = 0;
+    for (const DataFile::dictentry_t &d : dictionary)
+    {
+        if (d.replacement.size())
+            count++;
+    }
+    return count;
+}
+
+// Get the number of bytes used to store a reference.
+static size_t ref_length(int ref)
+{
+    return (ref >= EXTENDED_REF_BASE) ? 2 : 1;
+}
+
+// Append a reference to the encoded string.
+static void append_ref(encoded_font_t::refstring_t &result, int ref)
+{
+    if (ref >= EXTENDED_REF_BASE)
+    {
+        size_t index = ref - EXTENDED_REF_BASE;
+        result.push_back(REF_EXTENDED + (index >> 8));
+        result.push_back(index & 0xFF);
+    }
+    else
+    {
+        result.push_back(ref);
+    }
+}
+
 // Count the number of equal pixels at the beginning of the pixelstring.
 static size_t prefix_length(const DataFile::pixels_t &pixels, size_t pos)
 {
@@ -302,8 +350,11 @@ static void fill_tree_suffixes(DictTreeNode *root, DictTreeNode *subtree,
     }
 }
 
-// Construct a lookup tree from the dictionary entries.
+// Construct a lookup tree from the dictionary entries. The first
+// dict_code_count entries get one-byte codes, and the codes after them
+// are used for the fill entries.
 static DictTreeNode* construct_tree(const std::vector<DataFile::dictentry_t> &dictionary,
+                                    size_t dict_code_count,
                                     TreeAllocator &storage, bool fast)
 {
     DictTreeNode* root = storage.allocate();
@@ -318,17 +369,21 @@ static DictTreeNode* construct_tree(const std::vector<DataFile::dictentry_t> &di
         root->SetChild(j, node);
     }
 
-    // Populate the actual dictionary entries
-    size_t i = DICT_START;
-    for (DataFile::dictentry_t d : dictionary)
-    {
-        if (!d.replacement.size())
-            break;
+    // Populate the actual dictionary entries. Entries that do not fit in
+    // the one-byte codes are encoded as extended references.
+    size_t count = 0;
+    while (count < dictionary.size() && dictionary.at(count).replacement.size())
+        count++;
 
-        add_tree_entry(d.replacement, i, d.ref_encode, root, storage);
-        i++;
+    for (size_t j = 0; j < count; j++)
+    {
+        const DataFile::dictentry_t &d = dictionary.at(j);
+        int ref = (j < dict_code_count) ? DICT_START + j : EXTENDED_REF_BASE + j;
+        add_tree_entry(d.replacement, ref, d.ref_encode, root, storage);
     }
 
+    size_t i = DICT_START + dict_code_count;
+
     if (!fast)
     {
         // Populate the fill entries for rest of dictionary
@@ -364,7 +419,7 @@ struct encoding_link_t
     // Index of the dictionary entry that brings us to this point.
     int index;
 
-    // Number of links to get here from the start of the string.
+    // Number of bytes to get here from the start of the string.
     size_t length;
 
     constexpr encoding_link_t(): previous(0), index(-1), length(9999999) {}
@@ -411,7 +466,7 @@ static encoded_font_t::refstring_t encode_ref_slow(const DataFile::pixels_t &pix
                 encoding_link_t link;
                 link.previous = pos + 1 - suffix->GetLength();
                 link.index = suffix->GetIndex();
-                link.length = chain[link.previous].length + 1;
+                link.length = chain[link.previous].length + ref_length(link.index);
 
                 if (link.length < chain[pos + 1].length)
                     chain[pos + 1] = link;
@@ -440,17 +495,20 @@ static encoded_font_t::refstring_t encode_ref_slow(const DataFile::pixels_t &pix
 
     // Backtrack from the final link back to the start and construct the
     // encoded string.
-    encoded_font_t::refstring_t result;
-    size_t len = chain[pixels.size()].length;
-    result.resize(len);
-
+    std::vector<int> refs;
     size_t pos = pixels.size();
-    for (size_t i = len; i > 0; i--)
+    while (pos > 0)
     {
-        result.at(i - 1) = chain[pos].index;
+        refs.push_back(chain[pos].index);
         pos = chain[pos].previous;
     }
 
+    encoded_font_t::refstring_t result;
+    for (auto iter = refs.rbegin(); iter != refs.rend(); ++iter)
+    {
+        append_ref(result, *iter);
+    }
+
     return result;
 }
 
@@ -513,7 +571,7 @@ static encoded_font_t::refstring_t encode_ref_fast(const DataFile::pixels_t &pix
     {
         int index;
         i += walk_tree(tree, pixels.begin() + i, pixels.end(), index, is_glyph);
-        result.push_back(index);
+        append_ref(result, index);
     }
 
     if (i < pixels.size())
@@ -547,6 +605,19 @@ static bool cmp_dict_coding(const DataFile::dictentry_t &a,
         return false;
 }
 
+// Same as above, but puts the entries with highest score first within each
+// coding type, so that they get the one-byte codes.
+static bool cmp_dict_coding_score(const DataFile::dictentry_t &a,
+                                  const DataFile::dictentry_t &b)
+{
+    if (cmp_dict_coding(a, b))
+        return true;
+    else if (cmp_dict_coding(b, a))
+        return false;
+    else
+        return a.score > b.score;
+}
+
 size_t estimate_tree_node_count(const std::vector<DataFile::dictentry_t> &dict)
 {
     size_t count = DICT_START; // Preallocated entries
@@ -558,20 +629,204 @@ size_t estimate_tree_node_count(const std::vector<DataFile::dictentry_t> &dict)
     return count;
 }
 
+std::vector<size_t> get_codeword_offsets(const encoded_font_t::refstring_t &refstring)
+{
+    std::vector<size_t> result;
+    size_t pos = 0;
+    while (pos < refstring.size())
+    {
+        result.push_back(pos);
+
+        uint8_t ref = refstring.at(pos);
+        if (ref >= REF_EXTENDED && ref < REF_EXTENDED + REF_EXTENDED_COUNT)
+            pos += 2;
+        else
+            pos += 1;
+    }
+    return result;
+}
+
+std::vector<row_checkpoint_t> get_row_checkpoints(const encoded_font_t &encoded,
+                                                  size_t index,
+                                                  const DataFile::fontinfo_t &fontinfo,
+                                                  size_t interval)
+{
+    const encoded_font_t::refstring_t &refstring = encoded.glyphs.at(index);
+    size_t width = fontinfo.max_width;
+    size_t height = fontinfo.max_height;
+    if (!encoded.glyph_boxes.empty())
+    {
+        width = encoded.glyph_boxes.at(index).width;
+        height = encoded.glyph_boxes.at(index).height;
+    }
+
+    std::vector<row_checkpoint_t> result;
+    if (height == 0 || width == 0)
+        return result;
+
+    // Start pixel of each codeword. Decoding the codewords one at a time
+    // gives their lengths; the fill code is always the last one.
+    std::vector<size_t> offsets = get_codeword_offsets(refstring);
+    std::vector<size_t> pixels;
+    size_t pos = 0;
+    for (size_t i = 0; i < offsets.size(); i++)
+    {
+        pixels.push_back(pos);
+
+        size_t end = (i + 1 < offsets.size()) ? offsets.at(i + 1) : refstring.size();
+        encoded_font_t::refstring_t codeword(refstring.begin() + offsets.at(i),
+                                             refstring.begin() + end);
+        if (codeword.front() != REF_FILLZEROS)
+            pos += decode_glyph(encoded, codeword, fontinfo)->size();
+    }
+
+    size_t count = (height - 1) / interval;
+    size_t i = 0;
+    for (size_t row = interval; result.size() < count; row += interval)
+    {
+        while (i + 1 < offsets.size() && pixels.at(i + 1) <= row * width)
+            i++;
+
+        row_checkpoint_t c;
+        c.offset = offsets.at(i);
+        c.pixel = pixels.at(i);
+        result.push_back(c);
+    }
+
+    return result;
+}
+
+std::vector<size_t> get_dict_code_counts(const DataFile &datafile)
+{
+    // Each candidate frees the codes of one more group of fill entries.
+    static const size_t fill_starts[] = {
+        DICT_START2BIT, DICT_START3BIT, DICT_START4BIT,
+        DICT_START5BIT, DICT_START6BIT
+    };
+
+    size_t dict_count = get_dict_count(datafile.GetDictionary());
+    std::vector<size_t> result;
+    result.push_back(get_onebyte_count(dict_count));
+
+    for (size_t start : fill_starts)
+    {
+        if (start - DICT_START < result.front())
+            result.push_back(start - DICT_START);
+    }
+
+    return result;
+}
+
+// Encode the font with each of the worthwhile dictionary code counts, and
+// return the smallest result.
+static std::unique_ptr<encoded_font_t> encode_smallest(const DataFile &datafile,
+                                                       bool fast, bool crop)
+{
+    std::vector<size_t> candidates = get_dict_code_counts(datafile);
+
+    // Fill entries are not used in the fast mode, so the split makes
+    // no difference there.
+    if (fast)
+        return encode_font(datafile, fast, candidates.front(), crop);
+
+    std::unique_ptr<encoded_font_t> best;
+    size_t best_size = 0;
+    for (size_t dict_code_count : candidates)
+    {
+        std::unique_ptr<encoded_font_t> e = encode_font(datafile, fast, dict_code_count, crop);
+        size_t size = get_encoded_size(*e);
+
+        if (!best || size < best_size)
+        {
+            best = std::move(e);
+            best_size = size;
+        }
+    }
+
+    return best;
+}
+
 std::unique_ptr<encoded_font_t> encode_font(const DataFile &datafile,
                                             bool fast)
+{
+    return encode_smallest(datafile, fast, false);
+}
+
+std::unique_ptr<encoded_font_t> encode_font_cropped(const DataFile &datafile,
+                                                    bool fast)
+{
+    return encode_smallest(datafile, fast, true);
+}
+
+// Find the smallest box that contains all the pixels of a glyph.
+static encoded_font_t::glyph_box_t get_glyph_box(const DataFile::pixels_t &pixels,
+                                                 const DataFile::fontinfo_t &fontinfo)
+{
+    int min_x = fontinfo.max_width, min_y = fontinfo.max_height;
+    int max_x = -1, max_y = -1;
+    for (int y = 0; y < fontinfo.max_height; y++)
+    {
+        for (int x = 0; x < fontinfo.max_width; x++)
+        {
+            if (pixels.at(y * fontinfo.max_width + x) != 0)
+            {
+                min_x = std::min(min_x, x);
+                min_y = std::min(min_y, y);
+                max_x = std::max(max_x, x);
+                max_y = std::max(max_y, y);
+            }
+        }
+    }
+
+    encoded_font_t::glyph_box_t box = {0, 0, 0, 0};
+    if (max_x >= 0)
+    {
+        box.x = min_x;
+        box.y = min_y;
+        box.width = max_x - min_x + 1;
+        box.height = max_y - min_y + 1;
+    }
+    return box;
+}
+
+// Get the pixels of a glyph that are inside the given box.
+static DataFile::pixels_t crop_pixels(const DataFile::pixels_t &pixels,
+                                      const DataFile::fontinfo_t &fontinfo,
+                                      const encoded_font_t::glyph_box_t &box)
+{
+    DataFile::pixels_t result;
+    for (int y = box.y; y < box.y + box.height; y++)
+    {
+        auto row = pixels.begin() + y * fontinfo.max_width;
+        result.insert(result.end(), row + box.x, row + box.x + box.width);
+    }
+    return result;
+}
+
+std::unique_ptr<encoded_font_t> encode_font(const DataFile &datafile,
+                                            bool fast,
+                                            size_t dict_code_count,
+                                            bool crop)
 {
     std::unique_ptr<encoded_font_t> result(new encoded_font_t);
 
     // Sort the dictionary so that RLE-coded entries come first.
     // This way the two are easy to distinguish based on index.
+    // If some entries need extended references, the highest scoring
+    // entries are put first to get the one-byte codes.
     std::vector<DataFile::dictentry_t> sorted_dict = datafile.GetDictionary();
-    std::stable_sort(sorted_dict.begin(), sorted_dict.end(), cmp_dict_coding);
+    dict_code_count = std::min(dict_code_count, get_dict_count(sorted_dict));
+    if (dict_code_count < get_dict_count(sorted_dict))
+        std::stable_sort(sorted_dict.begin(), sorted_dict.end(), cmp_dict_coding_score);
+    else
+        std::stable_sort(sorted_dict.begin(), sorted_dict.end(), cmp_dict_coding);
+
+    result->dict_code_count = dict_code_count;
 
     // Build the binary tree for looking up references.
     size_t count = estimate_tree_node_count(sorted_dict);
     TreeAllocator allocator(count);
-    DictTreeNode* tree = construct_tree(sorted_dict, allocator, fast);
+    DictTreeNode* tree = construct_tree(sorted_dict, dict_code_count, allocator, fast);
 
     // Encode the dictionary entries, using either RLE or reference method.
     for (const DataFile::dictentry_t &d : sorted_dict)
@@ -593,7 +848,45 @@ std::unique_ptr<encoded_font_t> encode_font(const DataFile &datafile,
     // Then reference-encode the glyphs
     for (const DataFile::glyphentry_t &g : datafile.GetGlyphTable())
     {
-        result->glyphs.push_back(encode_ref(g.data, tree, true, fast));
+        if (!crop)
+        {
+            result->glyphs.push_back(encode_ref(g.data, tree, true, fast));
+            continue;
+        }
+
+        // Empty glyphs need no codewords at all.
+        const DataFile::fontinfo_t &fontinfo = datafile.GetFontInfo();
+        encoded_font_t::glyph_box_t box = get_glyph_box(g.data, fontinfo);
+        if (box.width == 0)
+        {
+            result->glyph_boxes.push_back(box);
+            result->glyphs.push_back(encoded_font_t::refstring_t());
+            continue;
+        }
+
+        // The dictionary entries often span the empty space at the ends of
+        // the rows, so cropping only the empty rows or nothing at all can
+        // give a shorter encoding. Take the shortest, preferring the
+        // smaller box that is faster to decode.
+        encoded_font_t::glyph_box_t rows = {0, box.y, (uint8_t)fontinfo.max_width, box.height};
+        encoded_font_t::glyph_box_t full = {0, 0, (uint8_t)fontinfo.max_width, (uint8_t)fontinfo.max_height};
+
+        encoded_font_t::glyph_box_t best_box;
+        encoded_font_t::refstring_t best;
+        for (const encoded_font_t::glyph_box_t &b : {box, rows, full})
+        {
+            encoded_font_t::refstring_t r =
+                encode_ref(crop_pixels(g.data, fontinfo, b), tree, true, fast);
+
+            if (best.empty() || r.size() < best.size())
+            {
+                best = r;
+                best_box = b;
+            }
+        }
+
+        result->glyph_boxes.push_back(best_box);
+        result->glyphs.push_back(best);
     }
 
     // Optionally verify that the encoding was correct.
@@ -640,18 +933,66 @@ size_t get_encoded_size(const encoded_font_t &encoded)
         total += 2; // Offset table entry
         total += 1; // Width table entry
     }
+    total += encoded.glyph_boxes.size() * 4; // Box table entries
     return total;
 }
 
+// Decode a RLE-encoded dictionary entry and append it to result.
+static void decode_rle_dictentry(const encoded_font_t::rlestring_t &rlestring,
+                                 DataFile::pixels_t &result)
+{
+    for (uint8_t rle : rlestring)
+    {
+        if ((rle & RLE_CODEMASK) == RLE_ZEROS)
+        {
+            for (int i = 0; i < (rle & RLE_VALMASK); i++)
+            {
+                result.push_back(0);
+            }
+        }
+        else if ((rle & RLE_CODEMASK) == RLE_64ZEROS)
+        {
+            for (int i = 0; i < ((rle & RLE_VALMASK) + 1) * 64; i++)
+            {
+                result.push_back(0);
+            }
+        }
+        else if ((rle & RLE_CODEMASK) == RLE_ONES)
+        {
+            for (int i = 0; i < (rle & RLE_VALMASK) + 1; i++)
+            {
+                result.push_back(15);
+            }
+        }
+        else if ((rle & RLE_CODEMASK) == RLE_SHADE)
+        {
+            uint8_t count, alpha;
+            count = ((rle & RLE_VALMASK) >> 4) + 1;
+            alpha = ((rle & RLE_VALMASK) & 0xF);
+            for (int i = 0; i < count; i++)
+            {
+                result.push_back(alpha);
+            }
+        }
+    }
+}
+
 std::unique_ptr<DataFile::pixels_t> decode_glyph(
     const encoded_font_t &encoded,
     const encoded_font_t::refstring_t &refstring,
     const DataFile::fontinfo_t &fontinfo)
 {
     std::unique_ptr<DataFile::pixels_t> result(new DataFile::pixels_t);
+    size_t rle_count = encoded.rle_dictionary.size();
+    size_t dict_count = rle_count + encoded.ref_dictionary.size();
 
-    for (uint8_t ref : refstring)
+    for (size_t pos = 0; pos < refstring.size(); pos++)
     {
+        uint8_t ref = refstring.at(pos);
+
+        // Index of the dictionary entry, or -1 for other codes.
+        int entry = -1;
+
         if (ref <= 15)
         {
             result->push_back(ref);
@@ -660,54 +1001,23 @@ std::unique_ptr<DataFile::pixels_t> decode_glyph(
         {
             result->resize(fontinfo.max_width * fontinfo.max_height, 0);
         }
-        else if (ref < DICT_START)
+        else if (ref >= REF_EXTENDED && ref < REF_EXTENDED + REF_EXTENDED_COUNT)
         {
-            throw std::logic_error("unknown code: " + std::to_string(ref));
+            if (pos + 1 >= refstring.size())
+                throw std::logic_error("truncated extended reference");
+
+            entry = ((ref - REF_EXTENDED) << 8) | refstring.at(++pos);
+
+            if (entry >= (int)dict_count)
+                throw std::logic_error("unknown extended reference: " + std::to_string(entry));
         }
-        else if (ref - DICT_START < (int)encoded.rle_dictionary.size())
+        else if (ref < DICT_START)
         {
-            for (uint8_t rle : encoded.rle_dictionary.at(ref - DICT_START))
-            {
-                if ((rle & RLE_CODEMASK) == RLE_ZEROS)
-                {
-                    for (int i = 0; i < (rle & RLE_VALMASK); i++)
-                    {
-                        result->push_back(0);
-                    }
-                }
-                else if ((rle & RLE_CODEMASK) == RLE_64ZEROS)
-                {
-                    for (int i = 0; i < ((rle & RLE_VALMASK) + 1) * 64; i++)
-                    {
-                        result->push_back(0);
-                    }
-                }
-                else if ((rle & RLE_CODEMASK) == RLE_ONES)
-                {
-                    for (int i = 0; i < (rle & RLE_VALMASK) + 1; i++)
-                    {
-                        result->push_back(15);
-                    }
-                }
-                else if ((rle & RLE_CODEMASK) == RLE_SHADE)
-                {
-                    uint8_t count, alpha;
-                    count = ((rle & RLE_VALMASK) >> 4) + 1;
-                    alpha = ((rle & RLE_VALMASK) & 0xF);
-                    for (int i = 0; i < count; i++)
-                    {
-                        result->push_back(alpha);
-                    }
-                }
-            }
+            throw std::logic_error("unknown code: " + std::to_string(ref));
         }
-        else if (ref - DICT_START - encoded.rle_dictionary.size() < encoded.ref_dictionary.size())
+        else if (ref - DICT_START < (int)encoded.dict_code_count)
         {
-            size_t index = ref - DICT_START - encoded.rle_dictionary.size();
-            std::unique_ptr<DataFile::pixels_t> part =
-                decode_glyph(encoded, encoded.ref_dictionary.at(index),
-                             fontinfo);
-            result->insert(result->end(), part->begin(), part->end());
+            entry = ref - DICT_START;
         }
         else
         {
@@ -720,6 +1030,22 @@ std::unique_ptr<DataFile::pixels_t> decode_glyph(
                 result->push_back(p);
             }
         }
+
+        if (entry < 0)
+        {
+            continue;
+        }
+        else if (entry < (int)rle_count)
+        {
+            decode_rle_dictentry(encoded.rle_dictionary.at(entry), *result);
+        }
+        else
+        {
+            std::unique_ptr<DataFile::pixels_t> part =
+                decode_glyph(encoded, encoded.ref_dictionary.at(entry - rle_count),
+                             fontinfo);
+            result->insert(result->end(), part->begin(), part->end());
+        }
     }
 
     return result;
@@ -729,7 +1055,29 @@ std::unique_ptr<DataFile::pixels_t> decode_glyph(
     const encoded_font_t &encoded, size_t index,
     const DataFile::fontinfo_t &fontinfo)
 {
-    return decode_glyph(encoded, encoded.glyphs.at(index), fontinfo);
+    if (encoded.glyph_boxes.empty())
+        return decode_glyph(encoded, encoded.glyphs.at(index), fontinfo);
+
+    // Decode the cropped glyph and place it in the font box.
+    const encoded_font_t::glyph_box_t &box = encoded.glyph_boxes.at(index);
+    DataFile::fontinfo_t cropinfo = fontinfo;
+    cropinfo.max_width = box.width;
+    cropinfo.max_height = box.height;
+
+    std::unique_ptr<DataFile::pixels_t> cropped =
+        decode_glyph(encoded, encoded.glyphs.at(index), cropinfo);
+    cropped->resize(box.width * box.height, 0);
+
+    std::unique_ptr<DataFile::pixels_t> result(
+        new DataFile::pixels_t(fontinfo.max_width * fontinfo.max_height, 0));
+    for (int y = 0; y < box.height; y++)
+    {
+        std::copy(cropped->begin() + y * box.width,
+                  cropped->begin() + (y + 1) * box.width,
+                  result->begin() + (box.y + y) * fontinfo.max_width + box.x);
+    }
+
+    return result;
 }
 
 }}
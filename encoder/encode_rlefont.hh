@@ -20,17 +20,72 @@ struct encoded_font_t
     // Each item is a reference to the dictionary.
     // Values 0 and 1 are hardcoded to mean 0 and 1.
     // All other values mean dictionary entry at (i-2).
+    // Extended references to large dictionaries take two bytes.
     typedef std::vector<uint8_t> refstring_t;
 
     std::vector<rlestring_t> rle_dictionary;
     std::vector<refstring_t> ref_dictionary;
     std::vector<refstring_t> glyphs;
+
+    // Number of dictionary entries that have one-byte codes. The rest of
+    // the one-byte codes are used for fill entries, and the rest of the
+    // dictionary entries for extended references.
+    size_t dict_code_count;
+
+    // Location and size of a glyph within the font box.
+    struct glyph_box_t
+    {
+        uint8_t x;
+        uint8_t y;
+        uint8_t width;
+        uint8_t height;
+    };
+
+    // Boxes of the glyphs, if each glyph is encoded cropped to the pixels
+    // it has. Empty if the glyphs cover the whole font box.
+    std::vector<glyph_box_t> glyph_boxes;
 };
 
-// Encode all the glyphs.
+// Encode all the glyphs. Tries the different splits between dictionary
+// and fill codes, and returns the smallest result.
 std::unique_ptr<encoded_font_t> encode_font(const DataFile &datafile,
                                             bool fast = true);
 
+// Encode all the glyphs using the given number of one-byte dictionary codes.
+// If crop is true, each glyph is encoded cropped to its own box.
+std::unique_ptr<encoded_font_t> encode_font(const DataFile &datafile,
+                                            bool fast,
+                                            size_t dict_code_count,
+                                            bool crop = false);
+
+// Encode all the glyphs cropped to their own boxes, so that the empty space
+// around narrow glyphs takes no codewords. Tries the different splits
+// between dictionary and fill codes, and returns the smallest result.
+std::unique_ptr<encoded_font_t> encode_font_cropped(const DataFile &datafile,
+                                                    bool fast = true);
+
+// Get the numbers of one-byte dictionary codes that are worth trying.
+// The first item is the default, which uses fill entries only for the
+// codes that are left over.
+std::vector<size_t> get_dict_code_counts(const DataFile &datafile);
+
+// Get the offsets of the codewords in a reference encoded string.
+std::vector<size_t> get_codeword_offsets(const encoded_font_t::refstring_t &refstring);
+
+// Checkpoint for starting the decoding of a glyph in the middle.
+struct row_checkpoint_t
+{
+    size_t offset; // Offset of the codeword in the glyph refstring.
+    size_t pixel;  // Index of the pixel where the codeword starts.
+};
+
+// Get the checkpoints for every interval rows of a glyph. Each one is the
+// last codeword that starts at or before the first pixel of the row.
+std::vector<row_checkpoint_t> get_row_checkpoints(const encoded_font_t &encoded,
+                                                  size_t index,
+                                                  const DataFile::fontinfo_t &fontinfo,
+                                                  size_t interval);
+
 // Sum up the total size of the encoded glyphs + dictionary.
 size_t get_encoded_size(const encoded_font_t &encoded);
 
@@ -107,6 +162,111 @@ public:
         }
     }
 
+    void testExtendedReference()
+    {
+        std::istringstream s(testfile);
+        std::unique_ptr<DataFile> f = DataFile::Load(s);
+        f->SetDictionarySize(300);
+
+        // Fill the one-byte codes with unused entries, so that the
+        // last entry must be reached through an extended reference.
+        for (size_t i = 4; i < 240; i++)
+        {
+            DataFile::dictentry_t d;
+            d.replacement = DataFile::pixels_t(i, 5);
+            d.score = 1;
+            f->SetDictionaryEntry(i, d);
+        }
+
+        DataFile::dictentry_t d;
+        d.replacement = {0, 14, 14, 14, 14, 0, 0, 0};
+        d.score = 0;
+        f->SetDictionaryEntry(240, d);
+
+        std::unique_ptr<encoded_font_t> e = encode_font(*f, false, 232);
+
+        encoded_font_t::refstring_t glyph2 = {0, 0, 0, 17, 239, 14, 14, 14, 0, 0, 0, 0, 26, 16};
+        TS_ASSERT_EQUALS(e->glyphs.at(2), glyph2);
+        TS_ASSERT_EQUALS(get_codeword_offsets(glyph2).size(), 13);
+
+        for (size_t i = 0; i < 3; i++)
+        {
+            std::unique_ptr<DataFile::pixels_t> dec;
+            dec = decode_glyph(*e, i, f->GetFontInfo());
+
+            TS_ASSERT_EQUALS(*dec, f->GetGlyphEntry(i).data);
+        }
+    }
+
+    void testDictCodeCount()
+    {
+        std::istringstream s(testfile);
+        std::unique_ptr<DataFile> f = DataFile::Load(s);
+
+        // With only one one-byte dictionary code, the fill entries start
+        // right after it.
+        std::unique_ptr<encoded_font_t> e = encode_font(*f, false, 1);
+        TS_ASSERT_EQUALS(e->dict_code_count, 1);
+
+        encoded_font_t::refstring_t glyph2 = {228, 17, 2, 244, 14, 14, 14, 228, 17, 2, 16};
+        TS_ASSERT_EQUALS(e->glyphs.at(2), glyph2);
+
+        for (size_t i = 0; i < 3; i++)
+        {
+            std::unique_ptr<DataFile::pixels_t> dec;
+            dec = decode_glyph(*e, i, f->GetFontInfo());
+
+            TS_ASSERT_EQUALS(*dec, f->GetGlyphEntry(i).data);
+        }
+
+        TS_ASSERT_EQUALS(get_dict_code_counts(*f).size(), 1);
+    }
+
+    void testCropped()
+    {
+        std::istringstream s(testfile);
+        std::unique_ptr<DataFile> f = DataFile::Load(s);
+        std::unique_ptr<encoded_font_t> e = encode_font_cropped(*f, false);
+
+        TS_ASSERT_EQUALS(e->glyph_boxes.size(), 3);
+
+        // Glyph 1 is shorter to encode with the full rows of the dictionary.
+        TS_ASSERT_EQUALS(e->glyph_boxes.at(1).x, 0);
+        TS_ASSERT_EQUALS(e->glyph_boxes.at(1).y, 0);
+        TS_ASSERT_EQUALS(e->glyph_boxes.at(1).width, 4);
+        TS_ASSERT_EQUALS(e->glyph_boxes.at(1).height, 6);
+        TS_ASSERT_EQUALS(e->glyph_boxes.at(2).x, 0);
+        TS_ASSERT_EQUALS(e->glyph_boxes.at(2).y, 1);
+        TS_ASSERT_EQUALS(e->glyph_boxes.at(2).width, 4);
+        TS_ASSERT_EQUALS(e->glyph_boxes.at(2).height, 5);
+
+        for (size_t i = 0; i < 3; i++)
+        {
+            std::unique_ptr<DataFile::pixels_t> dec;
+            dec = decode_glyph(*e, i, f->GetFontInfo());
+
+            TS_ASSERT_EQUALS(*dec, f->GetGlyphEntry(i).data);
+        }
+    }
+
+    void testRowCheckpoints()
+    {
+        std::istringstream s(testfile);
+        std::unique_ptr<DataFile> f = DataFile::Load(s);
+        std::unique_ptr<encoded_font_t> e = encode_font(*f, false);
+
+        // Glyph 2 is {228, 26, 244, 14, 14, 14, 228, 26, 16}, where the
+        // codewords start at pixels 0, 4, 8, 11, 12, 13, 14, 18 and 22.
+        std::vector<row_checkpoint_t> c = get_row_checkpoints(*e, 2, f->GetFontInfo(), 2);
+        TS_ASSERT_EQUALS(c.size(), 2);
+        TS_ASSERT_EQUALS(c.at(0).offset, 2);
+        TS_ASSERT_EQUALS(c.at(0).pixel, 8);
+        TS_ASSERT_EQUALS(c.at(1).offset, 6);
+        TS_ASSERT_EQUALS(c.at(1).pixel, 14);
+
+        TS_ASSERT_EQUALS(get_row_checkpoints(*e, 2, f->GetFontInfo(), 8).size(), 0);
+    }
+
 private:
     static constexpr const char *testfile =
         "Version 1\n"
@@ -12,34 +12,46 @@
 #include "ccfixes.hh"
 
 #define BWFONT_FORMAT_VERSION 4
+
+// Fonts that have a range map require a newer decoder.
+#define BWFONT_FORMAT_VERSION_RANGE_MAP 5
+
+// Fonts with row major glyph data require a still newer decoder.
+#define BWFONT_FORMAT_VERSION_ROW_MAJOR 6
 #define TYPECASE_FORMAT_VERSION 2
 
 namespace mcufont {
 namespace bwfont {
 
+static const int threshold = 8;
+
+// Find the number of columns in the glyph data
+static int count_columns(const DataFile::glyphentry_t &glyph,
+                         const DataFile::fontinfo_t &fontinfo)
+{
+    int num_cols = 0;
+    for (int x = 0; x < fontinfo.max_width; x++)
+    {
+        for (int y = 0; y < fontinfo.max_height; y++)
+        {
+            size_t index = y * fontinfo.max_width + x;
+            if (glyph.data.at(index) >= threshold)
+                num_cols = x + 1;
+        }
+    }
+    return num_cols;
+}
+
 static void encode_glyph(const DataFile::glyphentry_t &glyph,
                          const DataFile::fontinfo_t &fontinfo,
                          std::vector<unsigned> &dest,
                          int num_cols)
 {
-    const int threshold = 8;
-
     if (glyph.data.size() == 0)
         return;
 
-    // Find the number of columns in the glyph data
     if (num_cols == 0)
-    {
-        for (int x = 0; x < fontinfo.max_width; x++)
-        {
-            for (int y = 0; y < fontinfo.max_height; y++)
-            {
-                size_t index = y * fontinfo.max_width + x;
-                if (glyph.data.at(index) >= threshold)
-                    num_cols = x + 1;
-            }
-        }
-    }
+        num_cols = count_columns(glyph, fontinfo);
 
     // Write the bits that compose the glyph
     for (int x = 0; x < num_cols; x++)
@@ -61,6 +73,38 @@ static void encode_glyph(const DataFile::glyphentry_t &glyph,
     }
 }
 
+// Encode a glyph row by row, with the rows packed in bytes starting from
+// the most significant bit.
+static void encode_glyph_rows(const DataFile::glyphentry_t &glyph,
+                              const DataFile::fontinfo_t &fontinfo,
+                              std::vector<unsigned> &dest,
+                              int num_cols)
+{
+    if (glyph.data.size() == 0)
+        return;
+
+    if (num_cols == 0)
+        num_cols = count_columns(glyph, fontinfo);
+
+    for (int y = 0; y < fontinfo.max_height; y++)
+    {
+        for (int x = 0; x < num_cols; x += 8)
+        {
+            int remain = std::min(8, num_cols - x);
+            uint8_t byte = 0;
+            for (int i = 0; i < remain; i++)
+            {
+                size_t index = y * fontinfo.max_width + x + i;
+                if (glyph.data.at(index) >= threshold)
+                {
+                    byte |= (0x80 >> i);
+                }
+            }
+            dest.push_back(byte);
+        }
+    }
+}
+
 struct cropinfo_t
 {
     size_t offset_x;
@@ -75,7 +119,8 @@ static void encode_character_range(std::ostream &out,
                                    const DataFile &datafile,
                                    const char_range_t &range,
                                    unsigned range_index,
-                                   cropinfo_t &cropinfo)
+                                   cropinfo_t &cropinfo,
+                                   bool row_major)
 {
     std::vector<DataFile::glyphentry_t> glyphs;
     bool constant_width = true;
@@ -134,13 +179,17 @@ static void encode_character_range(std::ostream &out,
     std::vector<unsigned> offsets;
     std::vector<unsigned> data;
     std::vector<unsigned> widths;
-    size_t stride = cropinfo.height_bytes;
+    size_t stride = row_major ? cropinfo.height_pixels : cropinfo.height_bytes;
 
     for (const DataFile::glyphentry_t &g : glyphs)
     {
         offsets.push_back(data.size() / stride);
         widths.push_back(g.width);
-        encode_glyph(g, new_fi, data, width);
+
+        if (row_major)
+            encode_glyph_rows(g, new_fi, data, width);
+        else
+            encode_glyph(g, new_fi, data, width);
     }
     offsets.push_back(data.size() / stride);
 
@@ -153,10 +202,27 @@ static void encode_character_range(std::ostream &out,
     }
 }
 
-void write_source(std::ostream &out, std::string name, const DataFile &datafile)
+void write_source(std::ostream &out, std::string name, const DataFile &datafile,
+                  bool range_map, bool row_major)
 {
     name = filename_to_identifier(name);
 
+    // Split the characters into ranges
+    DataFile::fontinfo_t f = datafile.GetFontInfo();
+    size_t glyph_size = f.max_width * ((f.max_height + 7) / 8);
+    auto get_glyph_size = [=](size_t i) { return glyph_size; };
+    std::vector<char_range_t> ranges = compute_char_ranges(datafile,
+        get_glyph_size, 65536, 16);
+
+    // Optional table for finding the range of the first characters directly
+    std::vector<unsigned> map;
+    if (range_map)
+        map = compute_range_map(ranges);
+
+    int version = map.size() ? BWFONT_FORMAT_VERSION_RANGE_MAP : BWFONT_FORMAT_VERSION;
+    if (row_major)
+        version = BWFONT_FORMAT_VERSION_ROW_MAJOR;
+
     out << std::endl;
     out << std::endl;
     out << "/* Start of automatically generated font definition for " << name << ". */" << std::endl;
@@ -168,24 +234,18 @@ void write_source(std::ostream &out, std::string name, const DataFile &datafile)
     out << "#include \"mf_bwfont.h\"" << std::endl;
     out << std::endl;
 
-    out << "#ifndef MF_BWFONT_VERSION_" << BWFONT_FORMAT_VERSION << "_SUPPORTED" << std::endl;
+    out << "#ifndef MF_BWFONT_VERSION_" << version << "_SUPPORTED" << std::endl;
     out << "#error The font file is not compatible with this version of mcufont." << std::endl;
     out << "#endif" << std::endl;
     out << std::endl;
 
-    // Split the characters into ranges
-    DataFile::fontinfo_t f = datafile.GetFontInfo();
-    size_t glyph_size = f.max_width * ((f.max_height + 7) / 8);
-    auto get_glyph_size = [=](size_t i) { return glyph_size; };
-    std::vector<char_range_t> ranges = compute_char_ranges(datafile,
-        get_glyph_size, 65536, 16);
-
     // Write out glyph data for character ranges
     std::vector<cropinfo_t> crops;
     for (size_t i = 0; i < ranges.size(); i++)
     {
         cropinfo_t cropinfo;
-        encode_character_range(out, name, datafile, ranges.at(i), i, cropinfo);
+        encode_character_range(out, name, datafile, ranges.at(i), i, cropinfo,
+                               row_major);
         crops.push_back(cropinfo);
     }
 
@@ -207,11 +267,18 @@ void write_source(std::ostream &out, std::string name, const DataFile &datafile)
         out << "        " << widths << ", /* glyph widths */" << std::endl;
         out << "        " << offsets << ", /* glyph offsets */" << std::endl;
         out << "        " << "mf_bwfont_" << name << "_glyph_data_" << i << ", /* glyph data */" << std::endl;
+
+        if (row_major)
+            out << "        " << "1, /* row major */" << std::endl;
+
         out << "    }," << std::endl;
     }
     out << "};" << std::endl;
     out << std::endl;
 
+    if (map.size())
+        write_const_table(out, map, "uint8_t", "mf_bwfont_" + name + "_range_map", 1);
+
     // Fonts in this format are always black & white
     int flags = datafile.GetFontInfo().flags | DataFile::FLAG_BW;
 
@@ -231,11 +298,18 @@ void write_source(std::ostream &out, std::string name, const DataFile &datafile)
     out << "    " << select_fallback_char(datafile) << ", /* fallback character */" << std::endl;
     out << "    " << "&mf_bwfont_character_width," << std::endl;
     out << "    " << "&mf_bwfont_render_character," << std::endl;
+    out << "    " << "0, /* kerning */" << std::endl;
+    out << "    " << "0, /* ink boxes */" << std::endl;
+    out << "    " << "&mf_bwfont_render_rows," << std::endl;
     out << "    }," << std::endl;
 
-    out << "    " << BWFONT_FORMAT_VERSION << ", /* version */" << std::endl;
+    out << "    " << version << ", /* version */" << std::endl;
     out << "    " << ranges.size() << ", /* char range count */" << std::endl;
     out << "    " << "mf_bwfont_" << name << "_char_ranges," << std::endl;
+
+    if (map.size())
+        out << "    " << "mf_bwfont_" << name << "_range_map, /* range map */" << std::endl;
+
     out << "};" << std::endl;
 
     // Write the font lookup structure
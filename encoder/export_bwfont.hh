@@ -10,7 +10,12 @@ namespace bwfont {
 
 void write_header(std::ostream &out, std::string name, const DataFile &datafile);
 
-void write_source(std::ostream &out, std::string name, const DataFile &datafile);
+// Write out a font as C source code. If range_map is true, the font gets a
+// table for finding the first 256 characters without searching. If
+// row_major is true, the glyphs are stored row by row instead of column by
+// column, which makes the horizontal runs faster to find.
+void write_source(std::ostream &out, std::string name, const DataFile &datafile,
+                  bool range_map = false, bool row_major = false);
 
 void write_case(std::ostream &out, std::string name, const DataFile &datafile);
 
@@ -0,0 +1,233 @@
+#include "export_grayfont.hh"
+#include <vector>
+#include <string>
+#include <algorithm>
+#include "exporttools.hh"
+#include "ccfixes.hh"
+
+#define GRAYFONT_FORMAT_VERSION 1
+
+namespace mcufont {
+namespace grayfont {
+
+// Glyph data of a single glyph, cropped to its box.
+struct encoded_glyph_t
+{
+    bool missing;
+    int x;
+    int y;
+    int width;
+    int height;
+    std::vector<unsigned> data;
+};
+
+// Round a 4-bit alpha value to the given number of bits.
+static unsigned quantize(unsigned value, int bits_per_pixel)
+{
+    unsigned max = (1 << bits_per_pixel) - 1;
+    return (value * max + 7) / 15;
+}
+
+static encoded_glyph_t encode_glyph(const DataFile::glyphentry_t &glyph,
+                                    const DataFile::fontinfo_t &fontinfo,
+                                    int bits_per_pixel)
+{
+    encoded_glyph_t result = {};
+    result.data.push_back(glyph.width);
+
+    // Find the box of the pixels that are not empty after rounding.
+    int x0 = fontinfo.max_width, y0 = fontinfo.max_height, x1 = 0, y1 = 0;
+    for (int y = 0; y < fontinfo.max_height; y++)
+    {
+        for (int x = 0; x < fontinfo.max_width; x++)
+        {
+            size_t index = y * fontinfo.max_width + x;
+            if (quantize(glyph.data.at(index), bits_per_pixel))
+            {
+                x0 = std::min(x0, x);
+                y0 = std::min(y0, y);
+                x1 = std::max(x1, x + 1);
+                y1 = std::max(y1, y + 1);
+            }
+        }
+    }
+
+    if (x1 == 0)
+        return result;
+
+    result.x = x0;
+    result.y = y0;
+    result.width = x1 - x0;
+    result.height = y1 - y0;
+
+    // Pack the rows, leftmost pixel in the most significant bits.
+    for (int y = y0; y < y1; y++)
+    {
+        int shift = 8;
+        unsigned byte = 0;
+        for (int x = x0; x < x1; x++)
+        {
+            size_t index = y * fontinfo.max_width + x;
+            shift -= bits_per_pixel;
+            byte |= quantize(glyph.data.at(index), bits_per_pixel) << shift;
+
+            if (shift == 0)
+            {
+                result.data.push_back(byte);
+                byte = 0;
+                shift = 8;
+            }
+        }
+
+        if (shift != 8)
+            result.data.push_back(byte);
+    }
+
+    return result;
+}
+
+static void encode_character_range(std::ostream &out,
+                                   const std::string &name,
+                                   const std::vector<encoded_glyph_t> &glyphs,
+                                   const char_range_t &range,
+                                   unsigned range_index)
+{
+    std::vector<unsigned> offsets;
+    std::vector<unsigned> boxes;
+    std::vector<unsigned> data;
+
+    for (int glyph_index: range.glyph_indices)
+    {
+        offsets.push_back(data.size());
+
+        if (glyph_index < 0)
+        {
+            // Missing glyph, has no data at all.
+            boxes.insert(boxes.end(), {0, 0, 0, 0});
+            continue;
+        }
+
+        const encoded_glyph_t &g = glyphs.at(glyph_index);
+        boxes.insert(boxes.end(), {(unsigned)g.x, (unsigned)g.y,
+                                   (unsigned)g.width, (unsigned)g.height});
+        data.insert(data.end(), g.data.begin(), g.data.end());
+    }
+    offsets.push_back(data.size());
+
+    std::string suffix = "_" + std::to_string(range_index);
+    write_const_table(out, data, "uint8_t", "mf_grayfont_" + name + "_glyph_data" + suffix, 1);
+    write_const_table(out, offsets, "uint16_t", "mf_grayfont_" + name + "_glyph_offsets" + suffix, 1, 4);
+    write_const_table(out, boxes, "uint8_t", "mf_grayfont_" + name + "_glyph_boxes" + suffix, 1);
+}
+
+void write_source(std::ostream &out, std::string name, const DataFile &datafile,
+                  int bits_per_pixel, bool range_map)
+{
+    name = filename_to_identifier(name);
+
+    std::vector<encoded_glyph_t> glyphs;
+    for (size_t i = 0; i < datafile.GetGlyphCount(); i++)
+    {
+        glyphs.push_back(encode_glyph(datafile.GetGlyphEntry(i),
+                                      datafile.GetFontInfo(), bits_per_pixel));
+    }
+
+    // Split the characters into ranges, so that the offsets fit in 16 bits.
+    auto get_glyph_size = [&](size_t i) { return glyphs.at(i).data.size(); };
+    std::vector<char_range_t> ranges = compute_char_ranges(datafile,
+        get_glyph_size, 65535, 16);
+
+    // Optional table for finding the range of the first characters directly
+    std::vector<unsigned> map;
+    if (range_map)
+        map = compute_range_map(ranges);
+
+    out << std::endl;
+    out << std::endl;
+    out << "/* Start of automatically generated font definition for " << name << ". */" << std::endl;
+    out << std::endl;
+
+    out << "#include \"mf_grayfont.h\"" << std::endl;
+    out << std::endl;
+
+    out << "#ifndef MF_GRAYFONT_VERSION_" << GRAYFONT_FORMAT_VERSION << "_SUPPORTED" << std::endl;
+    out << "#error The font file is not compatible with this version of mcufont." << std::endl;
+    out << "#endif" << std::endl;
+    out << std::endl;
+
+    // Write out glyph data for character ranges
+    for (size_t i = 0; i < ranges.size(); i++)
+    {
+        encode_character_range(out, name, glyphs, ranges.at(i), i);
+    }
+
+    // Write out a table describing the character ranges
+    out << "static const struct mf_grayfont_char_range_s mf_grayfont_" + name + "_char_ranges[] = {" << std::endl;
+    for (size_t i = 0; i < ranges.size(); i++)
+    {
+        std::string suffix = "_" + std::to_string(i);
+
+        out << "    {" << std::endl;
+        out << "        " << ranges.at(i).first_char << ", /* first char */" << std::endl;
+        out << "        " << ranges.at(i).char_count << ", /* char count */" << std::endl;
+        out << "        " << "mf_grayfont_" << name << "_glyph_offsets" << suffix << "," << std::endl;
+        out << "        " << "mf_grayfont_" << name << "_glyph_boxes" << suffix << "," << std::endl;
+        out << "        " << "mf_grayfont_" << name << "_glyph_data" << suffix << "," << std::endl;
+        out << "    }," << std::endl;
+    }
+    out << "};" << std::endl;
+    out << std::endl;
+
+    if (map.size())
+        write_const_table(out, map, "uint8_t", "mf_grayfont_" + name + "_range_map", 1);
+
+    // Pull it all together in the grayfont_s structure.
+    out << "const struct mf_grayfont_s mf_grayfont_" << name << " = {" << std::endl;
+    out << "    {" << std::endl;
+    out << "    " << "\"" << datafile.GetFontInfo().name << "\"," << std::endl;
+    out << "    " << "\"" << name << "\"," << std::endl;
+    out << "    " << datafile.GetFontInfo().max_width << ", /* width */" << std::endl;
+    out << "    " << datafile.GetFontInfo().max_height << ", /* height */" << std::endl;
+    out << "    " << get_min_x_advance(datafile) << ", /* min x advance */" << std::endl;
+    out << "    " << get_max_x_advance(datafile) << ", /* max x advance */" << std::endl;
+    out << "    " << datafile.GetFontInfo().baseline_x << ", /* baseline x */" << std::endl;
+    out << "    " << datafile.GetFontInfo().baseline_y << ", /* baseline y */" << std::endl;
+    out << "    " << datafile.GetFontInfo().line_height << ", /* line height */" << std::endl;
+    out << "    " << datafile.GetFontInfo().flags << ", /* flags */" << std::endl;
+    out << "    " << select_fallback_char(datafile) << ", /* fallback character */" << std::endl;
+    out << "    " << "&mf_grayfont_character_width," << std::endl;
+    out << "    " << "&mf_grayfont_render_character," << std::endl;
+    out << "    " << "0, /* kerning */" << std::endl;
+    out << "    " << "0, /* ink boxes */" << std::endl;
+    out << "    " << "&mf_grayfont_render_rows," << std::endl;
+    out << "    }," << std::endl;
+
+    out << "    " << GRAYFONT_FORMAT_VERSION << ", /* version */" << std::endl;
+    out << "    " << bits_per_pixel << ", /* bits per pixel */" << std::endl;
+    out << "    " << ranges.size() << ", /* char range count */" << std::endl;
+    out << "    " << "mf_grayfont_" << name << "_char_ranges," << std::endl;
+
+    if (map.size())
+        out << "    " << "mf_grayfont_" << name << "_range_map, /* range map */" << std::endl;
+
+    out << "};" << std::endl;
+
+    // Write the font lookup structure
+    out << std::endl;
+    out << "#ifdef MF_INCLUDED_FONTS" << std::endl;
+    out << "/* List entry for searching fonts by name. */" << std::endl;
+    out << "static const struct mf_font_list_s mf_grayfont_" << name << "_listentry = {" << std::endl;
+    out << "    MF_INCLUDED_FONTS," << std::endl;
+    out << "    (struct mf_font_s*)&mf_grayfont_" << name << std::endl;
+    out << "};" << std::endl;
+    out << "#undef MF_INCLUDED_FONTS" << std::endl;
+    out << "#define MF_INCLUDED_FONTS (&mf_grayfont_" << name << "_listentry)" << std::endl;
+    out << "#endif" << std::endl;
+
+    out << std::endl;
+    out << std::endl;
+    out << "/* End of automatically generated font definition for " << name << ". */" << std::endl;
+    out << std::endl;
+}
+
+}}
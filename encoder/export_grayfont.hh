@@ -0,0 +1,18 @@
+// Write out the glyph data in C source code files for mf_grayfont format.
+
+#pragma once
+
+#include "datafile.hh"
+#include <iostream>
+
+namespace mcufont {
+namespace grayfont {
+
+// Write out a font as C source code, with bits_per_pixel of 2 or 4. The
+// 16 gray levels of the data file are rounded to the nearest level that
+// fits. If range_map is true, the font gets a table for finding the first
+// 256 characters without searching.
+void write_source(std::ostream &out, std::string name, const DataFile &datafile,
+                  int bits_per_pixel = 4, bool range_map = false);
+
+} }
@@ -6,23 +6,36 @@
 #include <algorithm>
 #include <string>
 #include <cctype>
+#include <stdexcept>
+#include <limits>
+#include <sstream>
 #include "exporttools.hh"
 #include "ccfixes.hh"
 
 #define RLEFONT_FORMAT_VERSION 4
 
+// Fonts that use the version 5 features, such as dictionaries with
+// extended references, require a newer decoder.
+#define RLEFONT_FORMAT_VERSION_EXTENDED 5
+
+// Number of glyphs that share one base offset in character ranges that
+// are larger than 64 kB. Must match MF_RLEFONT_OFFSET_BLOCK_SIZE.
+#define OFFSET_BLOCK_SIZE 64
+
+// Number of rows between the row checkpoints of the glyphs.
+#define ROW_CHECKPOINT_INTERVAL 16
+
+// Version of the common header of the typecase (.mff) files.
+#define TYPECASE_FORMAT_VERSION 2
+
 namespace mcufont {
 namespace rlefont {
 
-// Encode the dictionary entries and the offsets to them.
-// Generates tables dictionary_data and dictionary_offsets.
-static void encode_dictionary(std::ostream &out,
-                              const std::string &name,
-                              const DataFile &datafile,
-                              const encoded_font_t &encoded)
+// Collect the data of the dictionary entries and the offsets to them.
+static void get_dictionary_data(const encoded_font_t &encoded,
+                                std::vector<unsigned> &offsets,
+                                std::vector<unsigned> &data)
 {
-    std::vector<unsigned> offsets;
-    std::vector<unsigned> data;
     for (const encoded_font_t::rlestring_t &r : encoded.rle_dictionary)
     {
         offsets.push_back(data.size());
@@ -36,21 +49,35 @@ static void encode_dictionary(std::ostream &out,
     }
     offsets.push_back(data.size());
 
-    write_const_table(out, data, "uint8_t", "mf_rlefont_" + name + "_dictionary_data", 1);
-    write_const_table(out, offsets, "uint16_t", "mf_rlefont_" + name + "_dictionary_offsets", 1, 4);
+    if (data.size() > 65535)
+        throw std::runtime_error("dictionary data does not fit in 16-bit offsets");
 }
 
-// Encode the data tables for a single character range.
-// Generates tables glyph_data_i and glyph_offsets_i.
-static void encode_character_range(std::ostream &out,
+// Encode the dictionary entries and the offsets to them.
+// Generates tables dictionary_data and dictionary_offsets.
+static void encode_dictionary(std::ostream &out,
                               const std::string &name,
                               const DataFile &datafile,
-                              const encoded_font_t& encoded,
-                              const char_range_t& range,
-                              unsigned range_index)
+                              const encoded_font_t &encoded)
 {
     std::vector<unsigned> offsets;
     std::vector<unsigned> data;
+    get_dictionary_data(encoded, offsets, data);
+
+    write_const_table(out, data, "uint8_t", "mf_rlefont_" + name + "_dictionary_data", 1);
+    write_const_table(out, offsets, "uint16_t", "mf_rlefont_" + name + "_dictionary_offsets", 1, 4);
+}
+
+// Collect the glyph data and the offsets to it for a single character range.
+// If checkpoint_interval is nonzero, the row checkpoints of each glyph are
+// stored after its width.
+static void get_range_data(const DataFile &datafile,
+                           const encoded_font_t& encoded,
+                           const char_range_t& range,
+                           std::vector<unsigned> &offsets,
+                           std::vector<unsigned> &data,
+                           unsigned checkpoint_interval = 0)
+{
     std::map<size_t, unsigned> already_encoded;
 
     for (int glyph_index : range.glyph_indices)
@@ -62,76 +89,488 @@ static void encode_character_range(std::ostream &out,
         else
         {
             encoded_font_t::refstring_t r;
+            std::vector<row_checkpoint_t> checkpoints;
             int width = 0;
 
             if (glyph_index >= 0)
             {
                 r = encoded.glyphs[glyph_index];
                 width = datafile.GetGlyphEntry(glyph_index).width;
+
+                if (checkpoint_interval)
+                {
+                    checkpoints = get_row_checkpoints(encoded, glyph_index,
+                        datafile.GetFontInfo(), checkpoint_interval);
+                }
             }
 
             offsets.push_back(data.size());
             already_encoded[glyph_index] = data.size();
 
             data.push_back(width);
+
+            for (const row_checkpoint_t &c : checkpoints)
+            {
+                if (c.offset > 0xFFFF || c.pixel > 0xFFFF)
+                    throw std::logic_error("row checkpoint does not fit in 16 bits");
+
+                data.push_back(c.offset & 0xFF);
+                data.push_back(c.offset >> 8);
+                data.push_back(c.pixel & 0xFF);
+                data.push_back(c.pixel >> 8);
+            }
+
             data.insert(data.end(), r.begin(), r.end());
         }
     }
+}
+
+// Split the offsets of a range larger than 64 kB into base offsets for
+// each block of glyphs, and 16-bit offsets relative to them.
+// Returns false if the glyphs of a block are too far apart.
+static bool split_offsets(std::vector<unsigned> &offsets,
+                          std::vector<unsigned> &bases)
+{
+    for (size_t i = 0; i < offsets.size(); i += OFFSET_BLOCK_SIZE)
+    {
+        auto begin = offsets.begin() + i;
+        auto end = offsets.begin() + std::min(offsets.size(), i + OFFSET_BLOCK_SIZE);
+        unsigned base = *std::min_element(begin, end);
+
+        for (auto iter = begin; iter != end; ++iter)
+        {
+            *iter -= base;
+
+            if (*iter > 65535)
+                return false;
+        }
+
+        bases.push_back(base);
+    }
+
+    return true;
+}
+
+// Check if the offsets of a character range need to be split into blocks.
+static bool is_large_range(const std::vector<unsigned> &offsets)
+{
+    return *std::max_element(offsets.begin(), offsets.end()) > 65535;
+}
+
+// Get the widths of the glyphs in a character range.
+static std::vector<unsigned> get_range_widths(const DataFile &datafile,
+                                              const char_range_t &range)
+{
+    std::vector<unsigned> glyph_widths;
+    for (int glyph_index : range.glyph_indices)
+    {
+        if (glyph_index >= 0)
+            glyph_widths.push_back(datafile.GetGlyphEntry(glyph_index).width);
+        else
+            glyph_widths.push_back(0);
+    }
+
+    return glyph_widths;
+}
+
+// Get the boxes of the cropped glyphs in a character range, 4 bytes each.
+static std::vector<unsigned> get_range_boxes(const encoded_font_t &encoded,
+                                             const char_range_t &range)
+{
+    std::vector<unsigned> boxes;
+    for (int glyph_index : range.glyph_indices)
+    {
+        encoded_font_t::glyph_box_t box = {0, 0, 0, 0};
+        if (glyph_index >= 0)
+            box = encoded.glyph_boxes.at(glyph_index);
+
+        boxes.push_back(box.x);
+        boxes.push_back(box.y);
+        boxes.push_back(box.width);
+        boxes.push_back(box.height);
+    }
+
+    return boxes;
+}
+
+// Encode the data tables for a single character range.
+// Generates tables glyph_data_i and glyph_offsets_i, and for ranges larger
+// than 64 kB also glyph_offset_bases_i. Returns true if the last one was
+// generated. If widths is true, also generates table glyph_widths_i, and
+// for cropped glyphs table glyph_boxes_i.
+static bool encode_character_range(std::ostream &out,
+                              const std::string &name,
+                              const DataFile &datafile,
+                              const encoded_font_t& encoded,
+                              const char_range_t& range,
+                              unsigned range_index,
+                              bool widths,
+                              unsigned checkpoint_interval = 0)
+{
+    std::vector<unsigned> offsets;
+    std::vector<unsigned> data;
+    std::vector<unsigned> bases;
+    get_range_data(datafile, encoded, range, offsets, data, checkpoint_interval);
+
+    bool large = is_large_range(offsets);
+    if (large && !split_offsets(offsets, bases))
+        throw std::logic_error("glyph offsets of a range do not fit in 16 bits");
 
     write_const_table(out, data, "uint8_t", "mf_rlefont_" + name + "_glyph_data_" + std::to_string(range_index), 1);
     write_const_table(out, offsets, "uint16_t", "mf_rlefont_" + name + "_glyph_offsets_" + std::to_string(range_index), 1, 4);
+
+    if (large)
+        write_const_table(out, bases, "uint32_t", "mf_rlefont_" + name + "_glyph_offset_bases_" + std::to_string(range_index), 1, 8);
+
+    if (widths)
+    {
+        std::vector<unsigned> glyph_widths = get_range_widths(datafile, range);
+        write_const_table(out, glyph_widths, "uint8_t", "mf_rlefont_" + name + "_glyph_widths_" + std::to_string(range_index), 1);
+    }
+
+    if (encoded.glyph_boxes.size())
+    {
+        std::vector<unsigned> boxes = get_range_boxes(encoded, range);
+        write_const_table(out, boxes, "uint8_t", "mf_rlefont_" + name + "_glyph_boxes_" + std::to_string(range_index), 1);
+    }
+
+    return large;
 }
 
-void write_source(std::ostream &out, std::string name, const DataFile &datafile)
+// Split the characters into ranges. Large ranges are used when the offsets
+// can be split into blocks, otherwise the ranges are limited to 64 kB.
+static std::vector<char_range_t> get_char_ranges(const DataFile &datafile,
+                                                 const encoded_font_t &encoded,
+                                                 unsigned checkpoint_interval = 0)
 {
-    name = filename_to_identifier(name);
-    std::unique_ptr<encoded_font_t> encoded = encode_font(datafile, false);
+    auto get_glyph_size = [&](size_t i)
+    {
+        size_t size = encoded.glyphs[i].size() + 1; // +1 byte for glyph width
+        if (checkpoint_interval)
+        {
+            size += 4 * get_row_checkpoints(encoded, i, datafile.GetFontInfo(),
+                                            checkpoint_interval).size();
+        }
+        return size;
+    };
 
-    out << std::endl;
-    out << std::endl;
-    out << "/* Start of automatically generated font definition for " << name << ". */" << std::endl;
-    out << std::endl;
+    std::vector<char_range_t> ranges = compute_char_ranges(datafile,
+        get_glyph_size, std::numeric_limits<uint32_t>::max(), 16);
+
+    for (const char_range_t &range : ranges)
+    {
+        std::vector<unsigned> offsets;
+        std::vector<unsigned> data;
+        std::vector<unsigned> bases;
+        get_range_data(datafile, encoded, range, offsets, data, checkpoint_interval);
+
+        if (is_large_range(offsets) && !split_offsets(offsets, bases))
+            return compute_char_ranges(datafile, get_glyph_size, 65536, 16);
+    }
+
+    return ranges;
+}
+
+// Write the entry for a character range in the char_ranges table.
+// The fields added in version 5 are only written when needed.
+static void write_char_range_entry(std::ostream &out, const std::string &name,
+                                   const char_range_t &range, size_t index,
+                                   const std::string &dictionary, bool large,
+                                   bool widths, bool boxes,
+                                   unsigned checkpoint_interval = 0)
+{
+    out << "    {" << range.first_char
+        << ", " << range.char_count
+        << ", mf_rlefont_" << name << "_glyph_offsets_" << index
+        << ", mf_rlefont_" << name << "_glyph_data_" << index;
+
+    std::string suffix = "_" + std::to_string(index);
+    std::vector<std::string> fields = {
+        dictionary.size() ? dictionary : "0",
+        large ? "mf_rlefont_" + name + "_glyph_offset_bases" + suffix : "0",
+        widths ? "mf_rlefont_" + name + "_glyph_widths" + suffix : "0",
+        boxes ? "mf_rlefont_" + name + "_glyph_boxes" + suffix : "0",
+        std::to_string(checkpoint_interval)
+    };
 
+    while (fields.size() && fields.back() == "0")
+        fields.pop_back();
+
+    for (const std::string &field : fields)
+        out << ", " << field;
+
+    out << "}," << std::endl;
+}
+
+// Get the lowest format version that can represent the encoded font.
+static int get_format_version(const encoded_font_t &encoded)
+{
+    size_t dict_count = encoded.rle_dictionary.size() + encoded.ref_dictionary.size();
+
+    if (dict_count > encoded.dict_code_count)
+        return RLEFONT_FORMAT_VERSION_EXTENDED;
+    else
+        return RLEFONT_FORMAT_VERSION;
+}
+
+// Write the includes and the version check at the start of a font file.
+static void write_preamble(std::ostream &out, int version)
+{
     out << "#ifndef MF_RLEFONT_INTERNALS" << std::endl;
     out << "#define MF_RLEFONT_INTERNALS" << std::endl;
     out << "#endif" << std::endl;
     out << "#include \"mf_rlefont.h\"" << std::endl;
     out << std::endl;
 
-    out << "#ifndef MF_RLEFONT_VERSION_" << RLEFONT_FORMAT_VERSION << "_SUPPORTED" << std::endl;
+    out << "#ifndef MF_RLEFONT_VERSION_" << version << "_SUPPORTED" << std::endl;
     out << "#error The font file is not compatible with this version of mcufont." << std::endl;
     out << "#endif" << std::endl;
     out << std::endl;
+}
 
-    // Write out the dictionary entries
-    encode_dictionary(out, name, datafile, *encoded);
+static void write_font_struct(std::ostream &out, const std::string &name,
+                              const std::string &dictname,
+                              const DataFile &datafile,
+                              const encoded_font_t &encoded,
+                              size_t range_count, int version,
+                              const std::string &range_map,
+                              const std::string &kerning,
+                              const std::string &ink_boxes);
 
-    // Split the characters into ranges
-    auto get_glyph_size = [&encoded](size_t i)
+// Write the kerning table of a font, with the adjustments of the character
+// pairs and/or the edges of the glyphs in each range. Returns the name of
+// the table, or an empty string if the font does not need one.
+static std::string write_kerning_table(std::ostream &out, const std::string &name,
+                                       const DataFile &datafile,
+                                       const std::vector<char_range_t> &ranges,
+                                       bool write_pairs, bool write_edges)
+{
+    std::string tablename = "mf_rlefont_" + name + "_kerning";
+
+    if (datafile.GetFontInfo().flags & DataFile::FLAG_MONOSPACE)
+        return "";
+
+    std::vector<kerning_pair_t> pairs;
+    if (write_pairs)
+        pairs = compute_kerning_pairs(datafile, kerning_pair_char_limit);
+
+    if (pairs.size())
     {
-        return encoded->glyphs[i].size() + 1; // +1 byte for glyph width
-    };
-    std::vector<char_range_t> ranges = compute_char_ranges(datafile,
-        get_glyph_size, 65536, 16);
+        std::vector<unsigned> chars;
+        std::vector<unsigned> adjust;
+        for (const kerning_pair_t &p : pairs)
+        {
+            chars.push_back(p.first);
+            chars.push_back(p.second);
+            adjust.push_back(p.adjust & 0xFF);
+        }
+
+        write_const_table(out, chars, "uint8_t", tablename + "_chars", 1);
+        write_const_table(out, adjust, "uint8_t", tablename + "_adjust", 1);
+    }
+    else if (!write_edges)
+    {
+        return "";
+    }
+
+    if (write_edges)
+    {
+        for (size_t i = 0; i < ranges.size(); i++)
+        {
+            std::vector<unsigned> data;
+            for (int glyph_index : ranges.at(i).glyph_indices)
+            {
+                kerning_edges_t e;
+                if (glyph_index >= 0)
+                {
+                    e = compute_kerning_edges(datafile, glyph_index);
+                }
+                else
+                {
+                    e.left.resize(kerning_zones, 255);
+                    e.right.resize(kerning_zones, 0);
+                }
+
+                data.insert(data.end(), e.left.begin(), e.left.end());
+                data.insert(data.end(), e.right.begin(), e.right.end());
+            }
+
+            write_const_table(out, data, "uint8_t", tablename + "_edges_" + std::to_string(i), 1);
+        }
+
+        out << "static const struct mf_kerning_edges_s " << tablename << "_edge_ranges[] = {" << std::endl;
+        for (size_t i = 0; i < ranges.size(); i++)
+        {
+            out << "    {" << ranges.at(i).first_char
+                << ", " << ranges.at(i).char_count
+                << ", " << tablename << "_edges_" << i << "}," << std::endl;
+        }
+        out << "};" << std::endl;
+        out << std::endl;
+    }
+
+    out << "static const struct mf_kerning_table_s " << tablename << " = {" << std::endl;
+    out << "    " << kerning_space_percent << ", /* space percent */" << std::endl;
+    out << "    " << kerning_space_pixels << ", /* space pixels */" << std::endl;
+    out << "    " << kerning_limit << ", /* limit */" << std::endl;
+    out << "    " << kerning_zones << ", /* zone count */" << std::endl;
+    out << "    " << (write_pairs ? kerning_pair_char_limit : 0) << ", /* pair char limit */" << std::endl;
+    out << "    " << pairs.size() << ", /* pair count */" << std::endl;
+    if (pairs.size())
+    {
+        out << "    " << tablename << "_chars," << std::endl;
+        out << "    " << tablename << "_adjust," << std::endl;
+    }
+    else
+    {
+        out << "    0, 0," << std::endl;
+    }
+
+    if (write_edges)
+    {
+        out << "    " << ranges.size() << ", /* edge range count */" << std::endl;
+        out << "    " << tablename << "_edge_ranges," << std::endl;
+    }
+    out << "};" << std::endl;
+    out << std::endl;
+
+    return tablename;
+}
+
+// Write the ink bounding boxes of the glyphs in each range. Returns the name
+// of the table.
+static std::string write_ink_table(std::ostream &out, const std::string &name,
+                                   const DataFile &datafile,
+                                   const std::vector<char_range_t> &ranges)
+{
+    std::string tablename = "mf_rlefont_" + name + "_ink_boxes";
+
+    for (size_t i = 0; i < ranges.size(); i++)
+    {
+        std::vector<unsigned> data;
+        for (int glyph_index : ranges.at(i).glyph_indices)
+        {
+            // Characters that are not in the font are never looked up.
+            ink_box_t b = {0, 0, 0, 0};
+            if (glyph_index >= 0)
+                b = compute_ink_box(datafile, glyph_index);
+
+            data.push_back(b.left);
+            data.push_back(b.top);
+            data.push_back(b.right);
+            data.push_back(b.bottom);
+        }
+
+        write_const_table(out, data, "uint8_t", tablename + "_" + std::to_string(i), 1);
+    }
+
+    out << "static const struct mf_ink_range_s " << tablename << "_ranges[] = {" << std::endl;
+    for (size_t i = 0; i < ranges.size(); i++)
+    {
+        out << "    {" << ranges.at(i).first_char
+            << ", " << ranges.at(i).char_count
+            << ", " << tablename << "_" << i << "}," << std::endl;
+    }
+    out << "};" << std::endl;
+    out << std::endl;
+
+    out << "static const struct mf_ink_table_s " << tablename << " = {" << std::endl;
+    out << "    " << ranges.size() << ", /* range count */" << std::endl;
+    out << "    " << tablename << "_ranges," << std::endl;
+    out << "};" << std::endl;
+    out << std::endl;
+
+    return tablename;
+}
+
+// Write the glyph tables and the font structure for a single font.
+// The dictionary tables named by dictname must have been written already.
+// Returns the format version that the font requires.
+static int write_font(std::ostream &out, const std::string &name,
+                       const std::string &dictname,
+                       const DataFile &datafile,
+                       const encoded_font_t &encoded,
+                       const export_options_t &options)
+{
+    // Split the characters into ranges
+    unsigned interval = options.row_checkpoints ? ROW_CHECKPOINT_INTERVAL : 0;
+    std::vector<char_range_t> ranges = get_char_ranges(datafile, encoded, interval);
 
     // Write out glyph data for character ranges
+    std::vector<bool> large;
     for (size_t i = 0; i < ranges.size(); i++)
     {
-        encode_character_range(out, name, datafile, *encoded, ranges.at(i), i);
+        large.push_back(encode_character_range(out, name, datafile, encoded,
+                                               ranges.at(i), i, options.glyph_widths,
+                                               interval));
     }
 
     // Write out a table describing the character ranges
     out << "static const struct mf_rlefont_char_range_s mf_rlefont_" << name << "_char_ranges[] = {" << std::endl;
     for (size_t i = 0; i < ranges.size(); i++)
     {
-        out << "    {" << ranges.at(i).first_char
-            << ", " << ranges.at(i).char_count
-            << ", mf_rlefont_" << name << "_glyph_offsets_" << i
-            << ", mf_rlefont_" << name << "_glyph_data_" << i << "}," << std::endl;
+        write_char_range_entry(out, name, ranges.at(i), i, "", large.at(i),
+                               options.glyph_widths, encoded.glyph_boxes.size(),
+                               interval);
     }
     out << "};" << std::endl;
     out << std::endl;
 
+    int version = get_format_version(encoded);
+    if (std::count(large.begin(), large.end(), true) || options.glyph_widths ||
+        encoded.glyph_boxes.size() || interval)
+    {
+        version = RLEFONT_FORMAT_VERSION_EXTENDED;
+    }
+
+    // Optional table for finding the range of the first characters directly
+    std::vector<unsigned> map;
+    std::string mapname;
+    if (options.range_map)
+        map = compute_range_map(ranges);
+
+    if (map.size())
+    {
+        mapname = "mf_rlefont_" + name + "_range_map";
+        write_const_table(out, map, "uint8_t", mapname, 1);
+        version = RLEFONT_FORMAT_VERSION_EXTENDED;
+    }
+
+    // Optional precomputed kerning
+    std::string kerningname;
+    if (options.kerning || options.kerning_edges)
+    {
+        kerningname = write_kerning_table(out, name, datafile, ranges,
+                                          options.kerning, options.kerning_edges);
+    }
+
+    if (kerningname.size())
+        version = RLEFONT_FORMAT_VERSION_EXTENDED;
+
+    // Optional precomputed ink bounding boxes
+    std::string inkname;
+    if (options.ink_boxes)
+    {
+        inkname = write_ink_table(out, name, datafile, ranges);
+        version = RLEFONT_FORMAT_VERSION_EXTENDED;
+    }
+
+    write_font_struct(out, name, dictname, datafile, encoded, ranges.size(),
+                      version, mapname, kerningname, inkname);
+    return version;
+}
+
+// Write the rlefont_s structure and the font list entry. The dictionary
+// fields are filled in from the encoded font.
+static void write_font_struct(std::ostream &out, const std::string &name,
+                              const std::string &dictname,
+                              const DataFile &datafile,
+                              const encoded_font_t &encoded,
+                              size_t range_count, int version,
+                              const std::string &range_map,
+                              const std::string &kerning,
+                              const std::string &ink_boxes)
+{
     // Pull it all together in the rlefont_s structure.
     out << "const struct mf_rlefont_s mf_rlefont_" << name << " = {" << std::endl;
     out << "    {" << std::endl;
@@ -148,15 +587,29 @@ void write_source(std::ostream &out, std::string name, const DataFile &datafile)
     out << "    " << select_fallback_char(datafile) << ", /* fallback character */" << std::endl;
     out << "    " << "&mf_rlefont_character_width," << std::endl;
     out << "    " << "&mf_rlefont_render_character," << std::endl;
+    out << "    " << (kerning.size() ? "&" + kerning : "0") << ", /* kerning */" << std::endl;
+    out << "    " << (ink_boxes.size() ? "&" + ink_boxes : "0") << ", /* ink boxes */" << std::endl;
+    out << "    " << "&mf_rlefont_render_rows," << std::endl;
     out << "    }," << std::endl;
 
-    out << "    " << RLEFONT_FORMAT_VERSION << ", /* version */" << std::endl;
-    out << "    " << "mf_rlefont_" << name << "_dictionary_data," << std::endl;
-    out << "    " << "mf_rlefont_" << name << "_dictionary_offsets," << std::endl;
-    out << "    " << encoded->rle_dictionary.size() << ", /* rle dict count */" << std::endl;
-    out << "    " << encoded->ref_dictionary.size() + encoded->rle_dictionary.size() << ", /* total dict count */" << std::endl;
-    out << "    " << ranges.size() << ", /* char range count */" << std::endl;
+    out << "    " << version << ", /* version */" << std::endl;
+    out << "    " << "mf_rlefont_" << dictname << "_dictionary_data," << std::endl;
+    out << "    " << "mf_rlefont_" << dictname << "_dictionary_offsets," << std::endl;
+    out << "    " << encoded.rle_dictionary.size() << ", /* rle dict count */" << std::endl;
+    out << "    " << encoded.ref_dictionary.size() + encoded.rle_dictionary.size() << ", /* total dict count */" << std::endl;
+    out << "    " << range_count << ", /* char range count */" << std::endl;
     out << "    " << "mf_rlefont_" << name << "_char_ranges," << std::endl;
+
+    // The fields added in version 5 are only written when needed, so that
+    // other fonts still compile with older decoders.
+    if (version >= RLEFONT_FORMAT_VERSION_EXTENDED)
+    {
+        out << "    " << encoded.dict_code_count << ", /* dict code count */" << std::endl;
+
+        if (range_map.size())
+            out << "    " << range_map << ", /* range map */" << std::endl;
+    }
+
     out << "};" << std::endl;
 
     // Write the font lookup structure
@@ -170,6 +623,30 @@ void write_source(std::ostream &out, std::string name, const DataFile &datafile)
     out << "#undef MF_INCLUDED_FONTS" << std::endl;
     out << "#define MF_INCLUDED_FONTS (&mf_rlefont_" << name << "_listentry)" << std::endl;
     out << "#endif" << std::endl;
+}
+
+void write_source(std::ostream &out, std::string name, const DataFile &datafile,
+                  const export_options_t &options)
+{
+    name = filename_to_identifier(name);
+    std::unique_ptr<encoded_font_t> encoded;
+    if (options.crop_glyphs)
+        encoded = encode_font_cropped(datafile, false);
+    else
+        encoded = encode_font(datafile, false);
+
+    out << std::endl;
+    out << std::endl;
+    out << "/* Start of automatically generated font definition for " << name << ". */" << std::endl;
+    out << std::endl;
+
+    // The preamble depends on the features that the font ends up using.
+    std::ostringstream body;
+    encode_dictionary(body, name, datafile, *encoded);
+    int version = write_font(body, name, name, datafile, *encoded, options);
+
+    write_preamble(out, version);
+    out << body.str();
 
     out << std::endl;
     out << std::endl;
@@ -177,5 +654,393 @@ void write_source(std::ostream &out, std::string name, const DataFile &datafile)
     out << std::endl;
 }
 
-}}
+// Check that two dictionaries contain the same entries.
+static bool same_dictionary(const DataFile &a, const DataFile &b)
+{
+    if (a.GetDictionarySize() != b.GetDictionarySize())
+        return false;
+
+    for (size_t i = 0; i < a.GetDictionarySize(); i++)
+    {
+        const DataFile::dictentry_t &da = a.GetDictionaryEntry(i);
+        const DataFile::dictentry_t &db = b.GetDictionaryEntry(i);
+
+        if (da.replacement != db.replacement || da.ref_encode != db.ref_encode)
+            return false;
+    }
+
+    return true;
+}
+
+// Select the split between dictionary and fill codes that gives the
+// smallest total size for fonts sharing a dictionary.
+static size_t select_dict_code_count(const std::vector<const DataFile*> &datafiles)
+{
+    size_t best = 0;
+    size_t best_size = 0;
+    for (size_t candidate : get_dict_code_counts(*datafiles.front()))
+    {
+        size_t size = 0;
+        for (const DataFile *f : datafiles)
+        {
+            size += get_encoded_size(*encode_font(*f, false, candidate));
+        }
+
+        if (best_size == 0 || size < best_size)
+        {
+            best = candidate;
+            best_size = size;
+        }
+    }
+
+    return best;
+}
+
+void write_source_shared(std::ostream &out, std::string name,
+                         const std::vector<std::string> &fontnames,
+                         const std::vector<const DataFile*> &datafiles)
+{
+    name = filename_to_identifier(name);
+
+    for (const DataFile *f : datafiles)
+    {
+        if (!same_dictionary(*datafiles.front(), *f))
+            throw std::runtime_error("fonts do not share the same dictionary");
+    }
+
+    out << std::endl;
+    out << std::endl;
+    out << "/* Start of automatically generated font definitions for " << name << ". */" << std::endl;
+    out << std::endl;
+
+    // The dictionary is written only once, and all the fonts refer to it.
+    // They must also use the same split between dictionary and fill codes.
+    size_t dict_code_count = select_dict_code_count(datafiles);
+    std::unique_ptr<encoded_font_t> dictionary =
+        encode_font(*datafiles.front(), false, dict_code_count);
+    int version = get_format_version(*dictionary);
+
+    std::ostringstream body;
+    body << "/* Dictionary shared by all the fonts in this file. */" << std::endl;
+    encode_dictionary(body, name, *datafiles.front(), *dictionary);
+
+    for (size_t i = 0; i < datafiles.size(); i++)
+    {
+        std::string fontname = filename_to_identifier(fontnames.at(i));
+        std::unique_ptr<encoded_font_t> encoded =
+            encode_font(*datafiles.at(i), false, dict_code_count);
+        version = std::max(version,
+            write_font(body, fontname, name, *datafiles.at(i), *encoded,
+                       export_options_t()));
+        body << std::endl;
+    }
+
+    write_preamble(out, version);
+    out << body.str();
+
+    out << std::endl;
+    out << "/* End of automatically generated font definitions for " << name << ". */" << std::endl;
+    out << std::endl;
+}
+
+// Compute the box that covers the glyph boxes of all the parts.
+static DataFile::fontinfo_t combine_fontinfo(const std::vector<const DataFile*> &datafiles)
+{
+    DataFile::fontinfo_t result = datafiles.front()->GetFontInfo();
+    int left = 0, top = 0, right = 0, bottom = 0;
+
+    for (size_t i = 0; i < datafiles.size(); i++)
+    {
+        const DataFile::fontinfo_t &f = datafiles.at(i)->GetFontInfo();
+        int l = -f.baseline_x;
+        int t = -f.baseline_y;
+        int r = f.max_width - f.baseline_x;
+        int b = f.max_height - f.baseline_y;
+
+        if (i == 0 || l < left) left = l;
+        if (i == 0 || t < top) top = t;
+        if (i == 0 || r > right) right = r;
+        if (i == 0 || b > bottom) bottom = b;
+
+        result.line_height = std::max(result.line_height, f.line_height);
+        result.flags &= f.flags;
+    }
+
+    result.baseline_x = -left;
+    result.baseline_y = -top;
+    result.max_width = right - left;
+    result.max_height = bottom - top;
+    return result;
+}
+
+void write_source_parts(std::ostream &out, std::string name,
+                        const std::vector<const DataFile*> &datafiles)
+{
+    name = filename_to_identifier(name);
+
+    // Each character must be in only one of the parts.
+    std::set<int> chars;
+    std::vector<DataFile::glyphentry_t> glyphs;
+    for (const DataFile *f : datafiles)
+    {
+        for (const DataFile::glyphentry_t &g : f->GetGlyphTable())
+        {
+            for (int c : g.chars)
+            {
+                if (!chars.insert(c).second)
+                    throw std::runtime_error("character " + std::to_string(c) +
+                                             " is in several parts");
+            }
 
+            glyphs.push_back(g);
+        }
+    }
+
+    // Combined data file, used for the font-wide information.
+    DataFile::fontinfo_t fontinfo = combine_fontinfo(datafiles);
+    DataFile combined(std::vector<DataFile::dictentry_t>(), glyphs, fontinfo);
+
+    out << std::endl;
+    out << std::endl;
+    out << "/* Start of automatically generated font definition for " << name << ". */" << std::endl;
+    out << std::endl;
+
+    write_preamble(out, RLEFONT_FORMAT_VERSION_EXTENDED);
+
+    // Character ranges of all the parts, with the index of the part.
+    std::vector<std::pair<char_range_t, size_t> > ranges;
+    std::vector<std::unique_ptr<encoded_font_t> > encoded;
+
+    for (size_t i = 0; i < datafiles.size(); i++)
+    {
+        const DataFile &datafile = *datafiles.at(i);
+        const DataFile::fontinfo_t &f = datafile.GetFontInfo();
+        std::string partname = name + "_part" + std::to_string(i);
+
+        encoded.push_back(encode_font(datafile, false));
+        const encoded_font_t &e = *encoded.back();
+
+        encode_dictionary(out, partname, datafile, e);
+
+        out << "static const struct mf_rlefont_dict_s mf_rlefont_" << partname << "_dictionary = {" << std::endl;
+        out << "    " << "mf_rlefont_" << partname << "_dictionary_data," << std::endl;
+        out << "    " << "mf_rlefont_" << partname << "_dictionary_offsets," << std::endl;
+        out << "    " << e.rle_dictionary.size() << ", /* rle dict count */" << std::endl;
+        out << "    " << e.ref_dictionary.size() + e.rle_dictionary.size() << ", /* total dict count */" << std::endl;
+        out << "    " << e.dict_code_count << ", /* dict code count */" << std::endl;
+        out << "    " << fontinfo.baseline_x - f.baseline_x << ", /* offset x */" << std::endl;
+        out << "    " << fontinfo.baseline_y - f.baseline_y << ", /* offset y */" << std::endl;
+        out << "    " << f.max_width << ", /* width */" << std::endl;
+        out << "    " << f.max_height << ", /* height */" << std::endl;
+        out << "};" << std::endl;
+        out << std::endl;
+
+        for (const char_range_t &r : get_char_ranges(datafile, e))
+        {
+            ranges.push_back(std::make_pair(r, i));
+        }
+    }
+
+    // The ranges of different parts may interleave, keep them in order.
+    std::sort(ranges.begin(), ranges.end(),
+              [](const std::pair<char_range_t, size_t> &a,
+                 const std::pair<char_range_t, size_t> &b)
+              { return a.first.first_char < b.first.first_char; });
+
+    std::vector<bool> large;
+    for (size_t i = 0; i < ranges.size(); i++)
+    {
+        size_t part = ranges.at(i).second;
+        large.push_back(encode_character_range(out, name, *datafiles.at(part),
+                                               *encoded.at(part), ranges.at(i).first, i,
+                                               false));
+    }
+
+    out << "static const struct mf_rlefont_char_range_s mf_rlefont_" << name << "_char_ranges[] = {" << std::endl;
+    for (size_t i = 0; i < ranges.size(); i++)
+    {
+        std::string dictionary = "&mf_rlefont_" + name + "_part" +
+                                 std::to_string(ranges.at(i).second) + "_dictionary";
+        write_char_range_entry(out, name, ranges.at(i).first, i, dictionary,
+                               large.at(i), false, false);
+    }
+    out << "};" << std::endl;
+    out << std::endl;
+
+    // The dictionary fields of the font itself refer to the first part.
+    write_font_struct(out, name, name + "_part0", combined, *encoded.front(),
+                      ranges.size(), RLEFONT_FORMAT_VERSION_EXTENDED, "", "", "");
+
+    out << std::endl;
+    out << std::endl;
+    out << "/* End of automatically generated font definition for " << name << ". */" << std::endl;
+    out << std::endl;
+}
+
+// Contents of a typecase file, built in memory so that the offsets of the
+// tables can be filled in once they are placed. All the fields are little
+// endian.
+struct typecase_t
+{
+    std::vector<uint8_t> bytes;
+
+    void put8(unsigned value) { bytes.push_back(value & 0xFF); }
+    void put16(unsigned value) { put8(value); put8(value >> 8); }
+    void put32(unsigned value) { put16(value & 0xFFFF); put16(value >> 16); }
+
+    void put_string(const std::string &str)
+    {
+        put8(str.size());
+        bytes.insert(bytes.end(), str.begin(), str.end());
+    }
+
+    // Add a 32-bit offset field to be filled in later. Returns its position.
+    size_t reserve_offset()
+    {
+        size_t pos = bytes.size();
+        put32(0);
+        return pos;
+    }
+
+    // Add a table of items of the given size in bytes, and store its offset
+    // in the field at pos. The tables are aligned to 4 bytes, so that the
+    // decoder can use them in place.
+    void put_table(size_t pos, const std::vector<unsigned> &data, size_t item_size)
+    {
+        while (bytes.size() % 4)
+            put8(0);
+
+        size_t offset = bytes.size();
+        for (size_t i = 0; i < 4; i++)
+            bytes.at(pos + i) = (offset >> (8 * i)) & 0xFF;
+
+        for (unsigned value : data)
+        {
+            for (size_t i = 0; i < item_size; i++)
+                put8(value >> (8 * i));
+        }
+    }
+};
+
+// Positions of the offset fields of a character range in the typecase file.
+struct range_fields_t
+{
+    size_t glyph_offsets;
+    size_t glyph_data;
+    size_t glyph_offset_bases;
+    size_t glyph_widths;
+    size_t glyph_boxes;
+};
+
+void write_case(std::ostream &out, std::string name, const DataFile &datafile,
+                const export_options_t &options)
+{
+    name = filename_to_identifier(name);
+    std::unique_ptr<encoded_font_t> encoded;
+    if (options.crop_glyphs)
+        encoded = encode_font_cropped(datafile, false);
+    else
+        encoded = encode_font(datafile, false);
+
+    unsigned interval = options.row_checkpoints ? ROW_CHECKPOINT_INTERVAL : 0;
+    std::vector<char_range_t> ranges = get_char_ranges(datafile, *encoded, interval);
+
+    std::vector<unsigned> map;
+    if (options.range_map)
+        map = compute_range_map(ranges);
+
+    std::vector<unsigned> dict_offsets;
+    std::vector<unsigned> dict_data;
+    get_dictionary_data(*encoded, dict_offsets, dict_data);
+
+    // Collect the glyph tables, the same as write_font() does.
+    int version = get_format_version(*encoded);
+    std::vector<std::vector<unsigned>> offsets(ranges.size());
+    std::vector<std::vector<unsigned>> data(ranges.size());
+    std::vector<std::vector<unsigned>> bases(ranges.size());
+    for (size_t i = 0; i < ranges.size(); i++)
+    {
+        get_range_data(datafile, *encoded, ranges.at(i), offsets.at(i),
+                       data.at(i), interval);
+
+        if (is_large_range(offsets.at(i)))
+        {
+            if (!split_offsets(offsets.at(i), bases.at(i)))
+                throw std::logic_error("glyph offsets of a range do not fit in 16 bits");
+
+            version = RLEFONT_FORMAT_VERSION_EXTENDED;
+        }
+    }
+
+    if (options.glyph_widths || encoded->glyph_boxes.size() || interval || map.size())
+        version = RLEFONT_FORMAT_VERSION_EXTENDED;
+
+    // The common header, same as in the bwfont typecase files.
+    const DataFile::fontinfo_t &fontinfo = datafile.GetFontInfo();
+    typecase_t c;
+    c.bytes = {'f', 't', 'r', 'l'};
+    c.put8(TYPECASE_FORMAT_VERSION);
+    c.put8(version);
+    c.put8(fontinfo.max_width);
+    c.put8(fontinfo.max_height);
+    c.put8(get_min_x_advance(datafile));
+    c.put8(get_max_x_advance(datafile));
+    c.put8(fontinfo.baseline_x);
+    c.put8(fontinfo.baseline_y);
+    c.put8(fontinfo.line_height);
+    c.put8(fontinfo.flags);
+    c.put16(select_fallback_char(datafile));
+    c.put_string(fontinfo.name);
+    c.put_string(name);
+
+    // The fields of mf_rlefont_s, with the tables as offsets from the start
+    // of the file.
+    c.put16(encoded->rle_dictionary.size());
+    c.put16(encoded->rle_dictionary.size() + encoded->ref_dictionary.size());
+    c.put8(encoded->dict_code_count);
+    size_t dictionary_data = c.reserve_offset();
+    size_t dictionary_offsets = c.reserve_offset();
+    size_t range_map = c.reserve_offset();
+
+    c.put8(ranges.size());
+    std::vector<range_fields_t> fields;
+    for (const char_range_t &range : ranges)
+    {
+        range_fields_t f;
+        c.put16(range.first_char);
+        c.put16(range.char_count);
+        f.glyph_offsets = c.reserve_offset();
+        f.glyph_data = c.reserve_offset();
+        f.glyph_offset_bases = c.reserve_offset();
+        f.glyph_widths = c.reserve_offset();
+        f.glyph_boxes = c.reserve_offset();
+        c.put8(interval);
+        fields.push_back(f);
+    }
+
+    // Then the tables. The offsets of the tables that are left out stay zero.
+    c.put_table(dictionary_data, dict_data, 1);
+    c.put_table(dictionary_offsets, dict_offsets, 2);
+
+    if (map.size())
+        c.put_table(range_map, map, 1);
+
+    for (size_t i = 0; i < ranges.size(); i++)
+    {
+        c.put_table(fields.at(i).glyph_offsets, offsets.at(i), 2);
+        c.put_table(fields.at(i).glyph_data, data.at(i), 1);
+
+        if (bases.at(i).size())
+            c.put_table(fields.at(i).glyph_offset_bases, bases.at(i), 4);
+
+        if (options.glyph_widths)
+            c.put_table(fields.at(i).glyph_widths, get_range_widths(datafile, ranges.at(i)), 1);
+
+        if (encoded->glyph_boxes.size())
+            c.put_table(fields.at(i).glyph_boxes, get_range_boxes(*encoded, ranges.at(i)), 1);
+    }
+
+    out.write((const char*)c.bytes.data(), c.bytes.size());
+}
+
+}}
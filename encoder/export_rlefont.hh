@@ -5,11 +5,68 @@
 #include "datafile.hh"
 #include "encode_rlefont.hh"
 #include <iostream>
+#include <vector>
+#include <string>
 
 namespace mcufont {
 namespace rlefont {
 
-void write_source(std::ostream &out, std::string name, const DataFile &datafile);
+// Optional tables that make the decoder faster at the cost of some space.
+struct export_options_t
+{
+    // Table for finding the range of the first 256 characters without searching.
+    bool range_map;
+
+    // Tables of the glyph widths in each character range, so that measuring
+    // text does not need to read the glyph data.
+    bool glyph_widths;
+
+    // Kerning adjustments of the character pairs, so that the decoder does
+    // not need to analyze the glyphs.
+    bool kerning;
+
+    // Edges of each glyph for computing the kerning, which takes less space
+    // than the adjustments of the pairs in fonts with many characters.
+    bool kerning_edges;
+
+    // Ink bounding boxes of the glyphs, so that finding the white space
+    // around a character does not need to render it.
+    bool ink_boxes;
+
+    // Encode each glyph cropped to its own box, which makes narrow glyphs
+    // smaller and faster to decode.
+    bool crop_glyphs;
+
+    // Checkpoints for starting the decoding of tall glyphs in the middle,
+    // so that rendering only some of the rows is faster.
+    bool row_checkpoints;
+
+    export_options_t(): range_map(false), glyph_widths(false), kerning(false),
+                        kerning_edges(false), ink_boxes(false), crop_glyphs(false),
+                        row_checkpoints(false) {}
+};
+
+// Write out a font as C source code.
+void write_source(std::ostream &out, std::string name, const DataFile &datafile,
+                  const export_options_t &options = export_options_t());
+
+// Write out a font as a typecase (.mff) file, for loading at runtime with
+// mf_make_font(). The tables are aligned so that the decoder can use them
+// in place. The kerning, kerning edge and ink box options are not
+// supported, the decoder computes these from the glyphs instead.
+void write_case(std::ostream &out, std::string name, const DataFile &datafile,
+                const export_options_t &options = export_options_t());
+
+// Write out several fonts that share the same dictionary into a single
+// source file. The dictionary tables are named after the file.
+void write_source_shared(std::ostream &out, std::string name,
+                         const std::vector<std::string> &fontnames,
+                         const std::vector<const DataFile*> &datafiles);
+
+// Write out a single font made of several parts, each with its own
+// dictionary. The parts must not have any characters in common.
+void write_source_parts(std::ostream &out, std::string name,
+                        const std::vector<const DataFile*> &datafiles);
 
 } }
 
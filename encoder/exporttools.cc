@@ -1,6 +1,8 @@
 #include "exporttools.hh"
 #include <iomanip>
 #include <set>
+#include <map>
+#include <algorithm>
 
 namespace mcufont {
 
@@ -116,6 +118,161 @@ int select_fallback_char(const DataFile &datafile)
     return ' ';
 }
 
+kerning_edges_t compute_kerning_edges(const DataFile &datafile, size_t glyph_index)
+{
+    const DataFile::fontinfo_t &f = datafile.GetFontInfo();
+    const DataFile::glyphentry_t &g = datafile.GetGlyphEntry(glyph_index);
+    int zoneheight = std::max(1, (f.max_height + kerning_zones - 1) / kerning_zones);
+
+    kerning_edges_t result;
+    result.left.resize(kerning_zones, 255);
+    result.right.resize(kerning_zones, 0);
+
+    // The decoder uses the pixels that have more than half of the alpha
+    // value 7, i.e. any pixel that is not empty.
+    for (int y = 0; y < f.max_height; y++)
+    {
+        int zone = y / zoneheight;
+        for (int x = 0; x < f.max_width; x++)
+        {
+            if (g.data.at(y * f.max_width + x) == 0)
+                continue;
+
+            result.left.at(zone) = std::min(result.left.at(zone), x);
+            result.right.at(zone) = std::max(result.right.at(zone), x);
+        }
+    }
+
+    return result;
+}
+
+ink_box_t compute_ink_box(const DataFile &datafile, size_t glyph_index)
+{
+    const DataFile::fontinfo_t &f = datafile.GetFontInfo();
+    const DataFile::glyphentry_t &g = datafile.GetGlyphEntry(glyph_index);
+
+    int min_x = f.max_width, min_y = f.max_height;
+    int max_x = -1, max_y = -1;
+    for (int y = 0; y < f.max_height; y++)
+    {
+        for (int x = 0; x < f.max_width; x++)
+        {
+            if (g.data.at(y * f.max_width + x) == 0)
+                continue;
+
+            min_x = std::min(min_x, x);
+            min_y = std::min(min_y, y);
+            max_x = std::max(max_x, x);
+            max_y = std::max(max_y, y);
+        }
+    }
+
+    ink_box_t result;
+    if (max_x < 0)
+    {
+        // Fully white space
+        result.left = f.max_width;
+        result.top = f.max_height;
+        result.right = 0;
+        result.bottom = 0;
+    }
+    else
+    {
+        result.left = min_x;
+        result.top = min_y;
+        result.right = f.max_width - max_x - 1;
+        result.bottom = f.max_height - max_y - 1;
+    }
+
+    return result;
+}
+
+// Should kerning be done against this character? Same as in mf_kerning.c.
+static bool do_kerning(int c)
+{
+    if (c == ' ' || c == '\n' || c == '\r' || c == '\t')
+        return false;
+
+    if (c >= '0' && c <= '9')
+        return false;
+
+    return true;
+}
+
+// The same computation as mf_compute_kerning(), including the 8-bit
+// arithmetic of the decoder.
+static int compute_kerning(const kerning_edges_t &e1, int w1,
+                           const kerning_edges_t &e2, int w2)
+{
+    uint8_t min_space = 255;
+    for (int i = 0; i < kerning_zones; i++)
+    {
+        if (e2.left.at(i) == 255 || e1.right.at(i) == 0)
+            continue;
+
+        uint8_t space = w1 - e1.right.at(i) + e2.left.at(i);
+        if (space < min_space)
+            min_space = space;
+    }
+
+    if (min_space == 255)
+        return 0;
+
+    int normal_space = ((w1 + w2) / 2) * kerning_space_percent / 100;
+    normal_space += kerning_space_pixels;
+    int adjust = normal_space - min_space;
+    int max_adjust = -std::max(w1, w2) * kerning_limit / 100;
+
+    if (adjust > 0) adjust = 0;
+    if (adjust < max_adjust) adjust = max_adjust;
+
+    return adjust;
+}
+
+std::vector<kerning_pair_t> compute_kerning_pairs(const DataFile &datafile,
+                                                  size_t char_limit)
+{
+    std::vector<kerning_pair_t> result;
+
+    if (datafile.GetFontInfo().flags & DataFile::FLAG_MONOSPACE)
+        return result;
+
+    std::map<size_t, size_t> char_to_glyph = datafile.GetCharToGlyphMap();
+    std::map<size_t, kerning_edges_t> edges;
+    for (auto iter : char_to_glyph)
+    {
+        if (!edges.count(iter.second))
+            edges[iter.second] = compute_kerning_edges(datafile, iter.second);
+    }
+
+    for (auto first : char_to_glyph)
+    {
+        if (first.first >= char_limit || !do_kerning(first.first))
+            continue;
+
+        for (auto second : char_to_glyph)
+        {
+            if (second.first >= char_limit || !do_kerning(second.first))
+                continue;
+
+            int adjust = compute_kerning(
+                edges[first.second], datafile.GetGlyphEntry(first.second).width,
+                edges[second.second], datafile.GetGlyphEntry(second.second).width);
+
+            if (adjust != 0)
+            {
+                kerning_pair_t pair;
+                pair.first = first.first;
+                pair.second = second.first;
+                pair.adjust = adjust;
+                result.push_back(pair);
+            }
+        }
+    }
+
+    return result;
+}
+
 // Decide how to best divide the characters in the font into ranges.
 // Limitations are:
 //  - Gaps longer than minimum_gap should result in separate ranges.
@@ -184,5 +341,24 @@ std::vector<char_range_t> compute_char_ranges(const DataFile &datafile,
     return result;
 }
 
+std::vector<unsigned> compute_range_map(const std::vector<char_range_t> &ranges)
+{
+    std::vector<unsigned> result;
+
+    if (ranges.size() >= range_map_none)
+        return result;
+
+    result.resize(range_map_size, range_map_none);
+    for (size_t i = 0; i < ranges.size(); i++)
+    {
+        const char_range_t &r = ranges.at(i);
+        for (size_t c = r.first_char; c < (size_t)r.first_char + r.char_count && c < range_map_size; c++)
+        {
+            result.at(c) = i;
+        }
+    }
+
+    return result;
+}
 
 }
@@ -40,6 +40,64 @@ struct char_range_t
     char_range_t(): first_char(0), char_count(0) {}
 };
 
+// Number of characters covered by the range map, and the value used for
+// characters that are not in any range.
+static const size_t range_map_size = 256;
+static const unsigned range_map_none = 255;
+
+// Compute a table that gives the index of the character range for each of
+// the first range_map_size characters. Returns an empty table if there are
+// too many ranges to index with a byte.
+std::vector<unsigned> compute_range_map(const std::vector<char_range_t> &ranges);
+
+// Parameters of the kerning algorithm in mf_kerning.c. The precomputed
+// kerning tables agree with it only if these match mf_config.h.
+static const int kerning_space_percent = 15;
+static const int kerning_space_pixels = 3;
+static const int kerning_limit = 20;
+static const int kerning_zones = 16;
+
+// Edges of a glyph in each kerning zone, the same as what mf_kerning.c
+// finds by rendering the glyph. Empty zones have left edge 255 and right
+// edge 0.
+struct kerning_edges_t
+{
+    std::vector<int> left;
+    std::vector<int> right;
+};
+
+kerning_edges_t compute_kerning_edges(const DataFile &datafile, size_t glyph_index);
+
+// Kerning adjustment for a pair of characters.
+struct kerning_pair_t
+{
+    uint16_t first;
+    uint16_t second;
+    int adjust;
+};
+
+// The precomputed pairs cover the characters below this, which are the
+// ones that matter in most text. The rest are analyzed by the decoder.
+static const size_t kerning_pair_char_limit = 128;
+
+// Compute the kerning adjustments for all the pairs of characters below
+// char_limit that have one. The result is sorted by the first and then the
+// second character.
+std::vector<kerning_pair_t> compute_kerning_pairs(const DataFile &datafile,
+                                                  size_t char_limit);
+
+// Amount of white space at each edge of a glyph, the same as what
+// mf_character_whitespace() finds by rendering the glyph.
+struct ink_box_t
+{
+    int left;
+    int top;
+    int right;
+    int bottom;
+};
+
+ink_box_t compute_ink_box(const DataFile &datafile, size_t glyph_index);
+
 // Decide how to best divide the characters in the font into ranges.
 // Limitations are:
 //  - Gaps longer than minimum_gap should result in separate ranges.
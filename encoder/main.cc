@@ -6,15 +6,19 @@
 #include "encode_rlefont.hh"
 #include "optimize_rlefont.hh"
 #include "export_bwfont.hh"
+#include "export_grayfont.hh"
 #include <vector>
 #include <string>
 #include <set>
 #include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 #include <cstdlib>
 #include <ctime>
 #include <map>
+#include <algorithm>
+#include <cctype>
 #include "ccfixes.hh"
 #include "gb2312_in_ucs2.h"
 
@@ -267,13 +271,47 @@ static status_t cmd_show_glyph(const std::vector<std::string> &args)
     return STATUS_OK;
 }
 
-static status_t cmd_rlefont_export(const std::vector<std::string> &args)
+// Remove an optional keyword, such as 'rangemap', from the arguments
+// following the data file name.
+static bool get_export_option(std::vector<std::string> &args,
+                              const std::string &option)
 {
+    auto pos = std::find(args.begin() + std::min<size_t>(args.size(), 2),
+                         args.end(), option);
+    if (pos == args.end())
+        return false;
+
+    args.erase(pos);
+    return true;
+}
+
+static status_t cmd_rlefont_export(const std::vector<std::string> &cmdargs)
+{
+    std::vector<std::string> args = cmdargs;
+    mcufont::rlefont::export_options_t options;
+    options.range_map = get_export_option(args, "rangemap");
+    options.glyph_widths = get_export_option(args, "widths");
+    options.kerning = get_export_option(args, "kerning");
+    options.kerning_edges = get_export_option(args, "edges");
+    options.ink_boxes = get_export_option(args, "inkboxes");
+    options.crop_glyphs = get_export_option(args, "crop");
+    options.row_checkpoints = get_export_option(args, "checkpoints");
+
     if (args.size() != 2 && args.size() != 3)
         return STATUS_INVALID;
 
     std::string src = args.at(1);
     std::string dst = (args.size() == 2) ? strip_extension(src) + ".c" : args.at(2);
+    bool typecase = dst.find(".mff") != std::string::npos;
+
+    if (typecase && (options.kerning || options.kerning_edges || options.ink_boxes))
+    {
+        std::cerr << "Typecase files do not support the "
+                  << (options.kerning ? "kerning" : options.kerning_edges ? "edges" : "inkboxes")
+                  << " option" << std::endl;
+        return STATUS_INVALID;
+    }
+
     std::unique_ptr<DataFile> f = load_dat(src);
 
     if (!f)
@@ -281,8 +319,16 @@ static status_t cmd_rlefont_export(const std::vector<std::string> &args)
 
     {
         std::ofstream source(dst);
-        mcufont::rlefont::write_source(source, dst, *f);
-        std::cout << "Wrote " << dst << std::endl;
+        if (typecase)
+        {
+            mcufont::rlefont::write_case(source, dst, *f, options);
+            std::cout << "Wrote " << dst << " as typecase" << std::endl;
+        }
+        else
+        {
+            mcufont::rlefont::write_source(source, dst, *f, options);
+            std::cout << "Wrote " << dst << std::endl;
+        }
     }
 
     return STATUS_OK;
@@ -312,6 +358,39 @@ static status_t cmd_rlefont_size(const std::vector<std::string> &args)
     return STATUS_OK;
 }
 
+static status_t cmd_rlefont_dictsize(const std::vector<std::string> &args)
+{
+    if (args.size() != 3)
+        return STATUS_INVALID;
+
+    std::string src = args.at(1);
+    size_t size = std::stoi(args.at(2));
+    std::unique_ptr<DataFile> f = load_dat(src);
+
+    if (!f)
+        return STATUS_ERROR;
+
+    if (size < DataFile::dictionarysize || size > DataFile::maxdictionarysize)
+    {
+        std::cerr << "Dictionary size must be between " << DataFile::dictionarysize
+                  << " and " << DataFile::maxdictionarysize << std::endl;
+        return STATUS_ERROR;
+    }
+
+    std::cout << "Dictionary size was " << f->GetDictionarySize() << " entries." << std::endl;
+
+    // Fill any new entries with initial values for the optimizer.
+    f->SetDictionarySize(size);
+    mcufont::rlefont::init_dictionary(*f);
+
+    std::cout << "Dictionary size is now " << f->GetDictionarySize() << " entries." << std::endl;
+
+    if (!save_dat(src, f.get()))
+        return STATUS_ERROR;
+
+    return STATUS_OK;
+}
+
 static status_t cmd_rlefont_optimize(const std::vector<std::string> &args)
 {
     if (args.size() != 2 && args.size() != 3)
@@ -363,6 +442,173 @@ static status_t cmd_rlefont_optimize(const std::vector<std::string> &args)
     return STATUS_OK;
 }
 
+static status_t cmd_rlefont_optimize_shared(const std::vector<std::string> &args)
+{
+    if (args.size() < 3)
+        return STATUS_INVALID;
+
+    // The last argument is the iteration limit, if it is all digits.
+    std::vector<std::string> srcs(args.begin() + 1, args.end());
+    int limit = 100;
+    const std::string &last = srcs.back();
+    auto is_digit = [](char c) { return std::isdigit((unsigned char)c) != 0; };
+    if (!last.empty() && std::all_of(last.begin(), last.end(), is_digit))
+    {
+        limit = std::stoi(srcs.back());
+        srcs.pop_back();
+    }
+
+    if (srcs.size() < 2)
+        return STATUS_INVALID;
+
+    std::vector<std::unique_ptr<DataFile> > files;
+    std::vector<DataFile*> fileptrs;
+    for (const std::string &src : srcs)
+    {
+        files.push_back(load_dat(src));
+
+        if (!files.back())
+            return STATUS_ERROR;
+
+        fileptrs.push_back(files.back().get());
+    }
+
+    std::cout << "Optimizing a shared dictionary for " << srcs.size() << " fonts." << std::endl;
+    std::cout << "Press ctrl-C at any time to stop." << std::endl;
+    std::cout << "Results are saved automatically after each iteration." << std::endl;
+
+    if (limit > 0)
+        std::cout << "Limit is " << limit << " iterations" << std::endl;
+
+    int i = 0;
+    while (!limit || i < limit)
+    {
+        mcufont::rlefont::optimize_shared(fileptrs);
+
+        // The dictionary is stored only once in the exported file.
+        size_t newsize = 0;
+        for (size_t j = 0; j < fileptrs.size(); j++)
+        {
+            std::unique_ptr<mcufont::rlefont::encoded_font_t> e =
+                mcufont::rlefont::encode_font(*fileptrs.at(j));
+
+            if (j != 0)
+            {
+                e->rle_dictionary.clear();
+                e->ref_dictionary.clear();
+            }
+
+            newsize += mcufont::rlefont::get_encoded_size(*e);
+        }
+
+        i++;
+        std::cout << "iteration " << i << ", total size " << newsize
+                  << " bytes" << std::endl;
+
+        for (size_t j = 0; j < srcs.size(); j++)
+        {
+            if (!save_dat(srcs.at(j), fileptrs.at(j)))
+                return STATUS_ERROR;
+        }
+    }
+
+    return STATUS_OK;
+}
+
+static status_t cmd_rlefont_export_shared(const std::vector<std::string> &args)
+{
+    if (args.size() < 3)
+        return STATUS_INVALID;
+
+    std::string dst = args.at(1);
+    std::vector<std::unique_ptr<DataFile> > files;
+    std::vector<const DataFile*> fileptrs;
+    std::vector<std::string> names;
+
+    for (size_t i = 2; i < args.size(); i++)
+    {
+        files.push_back(load_dat(args.at(i)));
+
+        if (!files.back())
+            return STATUS_ERROR;
+
+        fileptrs.push_back(files.back().get());
+        names.push_back(strip_extension(args.at(i)));
+    }
+
+    {
+        std::ofstream source(dst);
+        mcufont::rlefont::write_source_shared(source, dst, names, fileptrs);
+        std::cout << "Wrote " << dst << std::endl;
+    }
+
+    return STATUS_OK;
+}
+
+static status_t cmd_rlefont_export_parts(const std::vector<std::string> &args)
+{
+    if (args.size() < 3)
+        return STATUS_INVALID;
+
+    std::string dst = args.at(1);
+    std::vector<std::unique_ptr<DataFile> > files;
+    std::vector<const DataFile*> fileptrs;
+
+    for (size_t i = 2; i < args.size(); i++)
+    {
+        files.push_back(load_dat(args.at(i)));
+
+        if (!files.back())
+            return STATUS_ERROR;
+
+        fileptrs.push_back(files.back().get());
+    }
+
+    {
+        std::ofstream source(dst);
+        mcufont::rlefont::write_source_parts(source, dst, fileptrs);
+        std::cout << "Wrote " << dst << std::endl;
+    }
+
+    return STATUS_OK;
+}
+
+// Code of a dictionary entry in the glyph data, as a decimal one-byte code
+// or as the two bytes of an extended reference in hex.
+static std::string dict_code_string(size_t index, size_t dict_code_count)
+{
+    if (index < dict_code_count)
+        return std::to_string(24 + index);
+
+    std::ostringstream code;
+    code << std::hex << std::setfill('0')
+         << "ext " << std::setw(2) << 17 + (index >> 8)
+         << ":" << std::setw(2) << (index & 0xFF);
+    return code.str();
+}
+
+// Write the codewords of a reference string in hex, with the two bytes of
+// extended references joined by a colon.
+static void write_refstring(std::ostream &out,
+                            const mcufont::rlefont::encoded_font_t::refstring_t &refs)
+{
+    std::vector<size_t> offsets = mcufont::rlefont::get_codeword_offsets(refs);
+    offsets.push_back(refs.size());
+
+    out << std::hex << std::setfill('0');
+    for (size_t j = 0; j + 1 < offsets.size(); j++)
+    {
+        for (size_t pos = offsets.at(j); pos < offsets.at(j + 1); pos++)
+        {
+            if (pos != offsets.at(j))
+                out << ":";
+            out << std::setw(2) << (int)refs.at(pos);
+        }
+        out << " ";
+    }
+    out << std::dec;
+}
+
 static status_t cmd_rlefont_show_encoded(const std::vector<std::string> &args)
 {
     if (args.size() != 2)
@@ -377,20 +623,25 @@ static status_t cmd_rlefont_show_encoded(const std::vector<std::string> &args)
     std::unique_ptr<mcufont::rlefont::encoded_font_t> e =
         mcufont::rlefont::encode_font(*f, false);
 
-    int i = 0;
+    // The first dict_code_count entries have one-byte codes from 24 up,
+    // the rest are reached through two-byte extended references.
+    size_t split = e->dict_code_count;
+    std::cout << "Dictionary codes: " << split << ", fill codes: "
+              << 256 - 24 - split << std::endl;
+
+    size_t i = 0;
     for (mcufont::rlefont::encoded_font_t::rlestring_t d : e->rle_dictionary)
     {
-        std::cout << "Dict RLE " << 24 + i++ << ": ";
+        std::cout << "Dict RLE " << dict_code_string(i++, split) << ": ";
         for (uint8_t v : d)
             std::cout << std::setfill('0') << std::setw(2) << std::hex << (int)v << " ";
-        std::cout << std::endl;
+        std::cout << std::dec << std::endl;
     }
 
     for (mcufont::rlefont::encoded_font_t::refstring_t d : e->ref_dictionary)
     {
-        std::cout << "Dict Ref " << 24 + i++ << ": ";
-        for (uint8_t v : d)
-            std::cout << std::setfill('0') << std::setw(2) << std::hex << (int)v << " ";
+        std::cout << "Dict Ref " << dict_code_string(i++, split) << ": ";
+        write_refstring(std::cout, d);
         std::cout << std::endl;
     }
 
@@ -398,21 +649,33 @@ static status_t cmd_rlefont_show_encoded(const std::vector<std::string> &args)
     for (mcufont::rlefont::encoded_font_t::refstring_t g : e->glyphs)
     {
         std::cout << "Glyph " << i++ << ": ";
-        for (uint8_t v : g)
-            std::cout << std::setfill('0') << std::setw(2) << std::hex << (int)v << " ";
+        write_refstring(std::cout, g);
         std::cout << std::endl;
     }
 
     return STATUS_OK;
 }
 
-static status_t cmd_bwfont_export(const std::vector<std::string> &args)
+static status_t cmd_bwfont_export(const std::vector<std::string> &cmdargs)
 {
+    std::vector<std::string> args = cmdargs;
+    bool range_map = get_export_option(args, "rangemap");
+    bool row_major = get_export_option(args, "rowmajor");
+
     if (args.size() != 2 && args.size() != 3)
         return STATUS_INVALID;
 
     std::string src = args.at(1);
     std::string dst = (args.size() == 2) ? strip_extension(src) + ".c" : args.at(2);
+    bool typecase = dst.find(".mff") != std::string::npos;
+
+    if (typecase && (range_map || row_major))
+    {
+        std::cerr << "Typecase files do not support the "
+                  << (range_map ? "rangemap" : "rowmajor") << " option" << std::endl;
+        return STATUS_INVALID;
+    }
+
     std::unique_ptr<DataFile> f = load_dat(src);
 
     if (!f)
@@ -425,14 +688,14 @@ static status_t cmd_bwfont_export(const std::vector<std::string> &args)
 
     {
         std::ofstream source(dst);
-        if(dst.find(".mff") != std::string::npos)
+        if(typecase)
         {
             mcufont::bwfont::write_case(source, dst, *f);
             std::cout << "Wrote " << dst << " as typecase" << std::endl;
         }
         else
         {
-            mcufont::bwfont::write_source(source, dst, *f);
+            mcufont::bwfont::write_source(source, dst, *f, range_map, row_major);
             std::cout << "Wrote " << dst << " as .c source" << std::endl;
         }
     }
@@ -440,6 +703,31 @@ static status_t cmd_bwfont_export(const std::vector<std::string> &args)
     return STATUS_OK;
 }
 
+static status_t cmd_grayfont_export(const std::vector<std::string> &cmdargs)
+{
+    std::vector<std::string> args = cmdargs;
+    bool range_map = get_export_option(args, "rangemap");
+    int bits_per_pixel = get_export_option(args, "2bpp") ? 2 : 4;
+
+    if (args.size() != 2 && args.size() != 3)
+        return STATUS_INVALID;
+
+    std::string src = args.at(1);
+    std::string dst = (args.size() == 2) ? strip_extension(src) + ".c" : args.at(2);
+    std::unique_ptr<DataFile> f = load_dat(src);
+
+    if (!f)
+        return STATUS_ERROR;
+
+    {
+        std::ofstream source(dst);
+        mcufont::grayfont::write_source(source, dst, *f, bits_per_pixel, range_map);
+        std::cout << "Wrote " << dst << std::endl;
+    }
+
+    return STATUS_OK;
+}
+
 
 static const char *usage_msg =
     "Usage: mcufont <command> [options] ...\n"
@@ -454,11 +742,35 @@ static const char *usage_msg =
     "Commands specific to rlefont format:\n"
     "   rlefont_size <datfile>                      Check the encoded size of the data file.\n"
     "   rlefont_optimize <datfile>                  Perform an optimization pass on the data file.\n"
-    "   rlefont_export <datfile> [outfile]          Export to .c source code.\n"
+    "   rlefont_dictsize <datfile> <entries>        Change the number of dictionary entries.\n"
+    "   rlefont_export <datfile> [outfile]<.c/.mff> [options] Export to .c source or a typecase file.\n"
     "   rlefont_show_encoded <datfile>              Show the encoded data for debugging.\n"
+    "   rlefont_optimize_shared <datfile> ... [n]   Optimize one dictionary shared by several fonts.\n"
+    "   rlefont_export_shared <outfile> <datfile> ... Export fonts sharing a dictionary to .c source.\n"
+    "   rlefont_export_parts <outfile> <datfile> ... Export one font with a dictionary for each part.\n"
+    "\n"
+    "   Export options: 'rangemap' adds a table for finding the first 256\n"
+    "   characters faster, 'widths' adds tables of the glyph widths,\n"
+    "   'kerning' adds a table of precomputed kerning for the ASCII\n"
+    "   characters, 'edges' adds the glyph edges for computing the kerning,\n"
+    "   'inkboxes' adds the bounding boxes of the glyphs for\n"
+    "   mf_character_whitespace(), 'crop' encodes each glyph cropped to its\n"
+    "   own box and 'checkpoints' adds row checkpoints for rendering only\n"
+    "   some rows of tall glyphs.\n"
+    "   'kerning', 'edges' and 'inkboxes' are for .c source only.\n"
     "\n"
     "Commands specific to bwfont format:\n"
-    "   bwfont_export <datfile> [outfile]<.c/.mff>  Export to .c source or a typecase file.\n"
+    "   bwfont_export <datfile> [outfile]<.c/.mff> [options] Export to .c source or a typecase file.\n"
+    "\n"
+    "   Export options: 'rangemap' adds a table for finding the first 256\n"
+    "   characters faster and 'rowmajor' stores the glyphs row by row, which\n"
+    "   is faster to render. Both are for .c source only.\n"
+    "\n"
+    "Commands specific to grayfont format:\n"
+    "   grayfont_export <datfile> [outfile] [options] Export to .c source code.\n"
+    "\n"
+    "   Export options: '2bpp' stores 4 gray levels instead of 16 and\n"
+    "   'rangemap' adds a table for finding the first 256 characters faster.\n"
     "";
 
 typedef status_t (*cmd_t)(const std::vector<std::string> &args);
@@ -469,9 +781,14 @@ static const std::map<std::string, cmd_t> command_list {
     {"show_glyph",              cmd_show_glyph},
     {"rlefont_size",            cmd_rlefont_size},
     {"rlefont_optimize",        cmd_rlefont_optimize},
+    {"rlefont_dictsize",        cmd_rlefont_dictsize},
     {"rlefont_export",          cmd_rlefont_export},
     {"rlefont_show_encoded",    cmd_rlefont_show_encoded},
+    {"rlefont_optimize_shared", cmd_rlefont_optimize_shared},
+    {"rlefont_export_shared",   cmd_rlefont_export_shared},
+    {"rlefont_export_parts",    cmd_rlefont_export_parts},
     {"bwfont_export",           cmd_bwfont_export},
+    {"grayfont_export",         cmd_grayfont_export},
 };
 
 int main(int argc, char **argv)
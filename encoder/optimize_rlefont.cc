@@ -62,7 +62,7 @@ void optimize_worst(DataFile &datafile, size_t &size, rnd_t &rnd, bool verbose)
 void optimize_any(DataFile &datafile, size_t &size, rnd_t &rnd, bool verbose)
 {
     DataFile trial = datafile;
-    std::uniform_int_distribution<size_t> dist(0, DataFile::dictionarysize - 1);
+    std::uniform_int_distribution<size_t> dist(0, datafile.GetDictionarySize() - 1);
     size_t index = dist(rnd);
     DataFile::dictentry_t d = trial.GetDictionaryEntry(index);
     d.replacement = *random_substring(datafile, rnd);
@@ -86,7 +86,7 @@ void optimize_any(DataFile &datafile, size_t &size, rnd_t &rnd, bool verbose)
 void optimize_expand(DataFile &datafile, size_t &size, rnd_t &rnd, bool verbose, bool binary_only)
 {
     DataFile trial = datafile;
-    std::uniform_int_distribution<size_t> dist1(0, DataFile::dictionarysize - 1);
+    std::uniform_int_distribution<size_t> dist1(0, datafile.GetDictionarySize() - 1);
     size_t index = dist1(rnd);
     DataFile::dictentry_t d = trial.GetDictionaryEntry(index);
 
@@ -140,7 +140,7 @@ void optimize_expand(DataFile &datafile, size_t &size, rnd_t &rnd, bool verbose,
 void optimize_trim(DataFile &datafile, size_t &size, rnd_t &rnd, bool verbose)
 {
     DataFile trial = datafile;
-    std::uniform_int_distribution<size_t> dist1(0, DataFile::dictionarysize - 1);
+    std::uniform_int_distribution<size_t> dist1(0, datafile.GetDictionarySize() - 1);
     size_t index = dist1(rnd);
     DataFile::dictentry_t d = trial.GetDictionaryEntry(index);
 
@@ -181,7 +181,7 @@ void optimize_trim(DataFile &datafile, size_t &size, rnd_t &rnd, bool verbose)
 void optimize_refdict(DataFile &datafile, size_t &size, rnd_t &rnd, bool verbose)
 {
     DataFile trial = datafile;
-    std::uniform_int_distribution<size_t> dist1(0, DataFile::dictionarysize - 1);
+    std::uniform_int_distribution<size_t> dist1(0, datafile.GetDictionarySize() - 1);
     size_t index = dist1(rnd);
     DataFile::dictentry_t d = trial.GetDictionaryEntry(index);
 
@@ -208,7 +208,7 @@ void optimize_refdict(DataFile &datafile, size_t &size, rnd_t &rnd, bool verbose
 void optimize_combine(DataFile &datafile, size_t &size, rnd_t &rnd, bool verbose)
 {
     DataFile trial = datafile;
-    std::uniform_int_distribution<size_t> dist1(0, DataFile::dictionarysize - 1);
+    std::uniform_int_distribution<size_t> dist1(0, datafile.GetDictionarySize() - 1);
     size_t worst = datafile.GetLowScoreIndex();
     size_t index1 = dist1(rnd);
     size_t index2 = dist1(rnd);
@@ -247,20 +247,30 @@ void optimize_encpart(DataFile &datafile, size_t &size, rnd_t &rnd, bool verbose
     size_t index = dist1(rnd);
     const encoded_font_t::refstring_t &refstr = e->glyphs.at(index);
 
-    if (refstr.size() < 2)
+    // Extended references take two bytes, so the part has to be cut at
+    // codeword boundaries.
+    std::vector<size_t> bounds = get_codeword_offsets(refstr);
+    bounds.push_back(refstr.size());
+
+    if (bounds.size() < 3)
         return;
 
     // Pick a random part of it
-    std::uniform_int_distribution<size_t> dist2(2, refstr.size());
+    std::uniform_int_distribution<size_t> dist2(2, bounds.size() - 1);
     size_t length = dist2(rnd);
-    std::uniform_int_distribution<size_t> dist3(0, refstr.size() - length);
+    std::uniform_int_distribution<size_t> dist3(0, bounds.size() - 1 - length);
     size_t start = dist3(rnd);
 
-    // Decode that part
-    encoded_font_t::refstring_t substr(refstr.begin() + start,
-                                       refstr.begin() + start + length);
+    // Decode that part. The glyphs of a shared dictionary can come from
+    // fonts of different sizes, so the fill code is decoded to the size
+    // of this glyph instead of the size in the font info.
+    encoded_font_t::refstring_t substr(refstr.begin() + bounds.at(start),
+                                       refstr.begin() + bounds.at(start + length));
+    DataFile::fontinfo_t fontinfo = datafile.GetFontInfo();
+    fontinfo.max_width = datafile.GetGlyphEntry(index).data.size();
+    fontinfo.max_height = 1;
     std::unique_ptr<DataFile::pixels_t> decoded =
-        decode_glyph(*e, substr, datafile.GetFontInfo());
+        decode_glyph(*e, substr, fontinfo);
 
     // Add that as a new dictionary entry
     DataFile trial = datafile;
@@ -339,7 +349,7 @@ void update_scores(DataFile &datafile, bool verbose)
 {
     size_t oldsize = get_encoded_size(datafile);
 
-    for (size_t i = 0; i < DataFile::dictionarysize; i++)
+    for (size_t i = 0; i < datafile.GetDictionarySize(); i++)
     {
         DataFile trial = datafile;
         DataFile::dictentry_t dummy = {};
@@ -374,9 +384,18 @@ void init_dictionary(DataFile &datafile)
     std::set<DataFile::pixels_t> seen_substrings;
     std::set<DataFile::pixels_t> added_substrings;
 
+    // Only the empty entries are filled, so that this can also be used
+    // after the dictionary has been enlarged.
     size_t i = 0;
-    while (i < DataFile::dictionarysize)
+    while (i < datafile.GetDictionarySize())
     {
+        if (datafile.GetDictionaryEntry(i).replacement.size() != 0)
+        {
+            added_substrings.insert(datafile.GetDictionaryEntry(i).replacement);
+            i++;
+            continue;
+        }
+
         DataFile::pixels_t substring = *random_substring(datafile, rnd);
 
         if (!seen_substrings.count(substring))
@@ -414,4 +433,39 @@ void optimize(DataFile &datafile, size_t iterations)
     datafile.SetSeed(dist(rnd));
 }
 
+void optimize_shared(const std::vector<DataFile*> &datafiles, size_t iterations)
+{
+    if (datafiles.empty())
+        return;
+
+    // Collect the glyphs of all the fonts into one data file. The encoded
+    // size of this combined file counts the dictionary only once, which is
+    // exactly the cost of the shared dictionary. The fonts can differ in
+    // size: the optimizer encodes the glyphs uncropped, which does not
+    // depend on the font info, and decodes them by their own size.
+    std::vector<DataFile::glyphentry_t> glyphs;
+    for (const DataFile *f : datafiles)
+    {
+        glyphs.insert(glyphs.end(), f->GetGlyphTable().begin(),
+                      f->GetGlyphTable().end());
+    }
+
+    const DataFile &first = *datafiles.front();
+    DataFile combined(first.GetDictionary(), glyphs, first.GetFontInfo());
+    combined.SetSeed(first.GetSeed());
+
+    optimize(combined, iterations);
+
+    for (DataFile *f : datafiles)
+    {
+        f->SetDictionarySize(combined.GetDictionarySize());
+        for (size_t i = 0; i < combined.GetDictionarySize(); i++)
+        {
+            f->SetDictionaryEntry(i, combined.GetDictionaryEntry(i));
+        }
+
+        f->SetSeed(combined.GetSeed());
+    }
+}
+
 }}
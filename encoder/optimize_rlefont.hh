@@ -12,4 +12,10 @@ void init_dictionary(DataFile &datafile);
 // of each of the optimization algorithms.
 void optimize(DataFile &datafile, size_t iterations = 50);
 
+// Optimize a single dictionary jointly over the glyphs of several fonts.
+// The resulting dictionary is stored back into each of the data files, so
+// that the fonts can be exported to reference a common dictionary.
+void optimize_shared(const std::vector<DataFile*> &datafiles,
+                     size_t iterations = 50);
+
 }}
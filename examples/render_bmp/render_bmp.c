@@ -23,6 +23,15 @@ typedef struct {
     int margin;
     int anchor;
     int scale;
+    int cachesize;
+    int ramsize;
+    bool direct;
+    bool pages;
+    bool masks;
+    bool rows;
+    bool clipped;
+    struct mf_rect_s clip;
+    int band;
 } options_t;
 
 static const char default_text[] =
@@ -41,7 +50,15 @@ static const char usage_text[] =
     "    -a l|c|r|j  Align left/center/right/justify.\n"
     "    -w width    Width of the image to render.\n"
     "    -m margin   Margin in the image.\n"
-    "    -s scale    Scale the font.\n";
+    "    -s scale    Scale the font.\n"
+    "    -c bytes    Size of the glyph cache to use.\n"
+    "    -t bytes    Decode the characters of the text to RAM of given size.\n"
+    "    -b          Render directly to the image buffer.\n"
+    "    -p          Render to a buffer of 8 pixel high pages.\n"
+    "    -r          Render a row of pixels at a time.\n"
+    "    -M          Render as black & white bit masks.\n"
+    "    -C x0,y0,x1,y1  Render only inside the given rectangle.\n"
+    "    -B rows     Render in bands of the given height.\n";
 
 /* Parse the command line options */
 static bool parse_options(int argc, const char **argv, options_t *options)
@@ -90,6 +107,49 @@ static bool parse_options(int argc, const char **argv, options_t *options)
         {
             options->scale = atoi(*argv++);
         }
+        else if (strcmp(cmd, "-c") == 0 && argc)
+        {
+            options->cachesize = atoi(*argv++);
+        }
+        else if (strcmp(cmd, "-t") == 0 && argc)
+        {
+            options->ramsize = atoi(*argv++);
+        }
+        else if (strcmp(cmd, "-b") == 0)
+        {
+            options->direct = true;
+        }
+        else if (strcmp(cmd, "-p") == 0)
+        {
+            options->pages = true;
+        }
+        else if (strcmp(cmd, "-M") == 0)
+        {
+            options->masks = true;
+        }
+        else if (strcmp(cmd, "-r") == 0)
+        {
+            options->rows = true;
+        }
+        else if (strcmp(cmd, "-C") == 0 && argc)
+        {
+            int x0, y0, x1, y1;
+            if (sscanf(*argv++, "%d,%d,%d,%d", &x0, &y0, &x1, &y1) != 4)
+            {
+                printf("Invalid clip rectangle\n");
+                return false;
+            }
+
+            options->clipped = true;
+            options->clip.x0 = x0;
+            options->clip.y0 = y0;
+            options->clip.x1 = x1;
+            options->clip.y1 = y1;
+        }
+        else if (strcmp(cmd, "-B") == 0 && argc)
+        {
+            options->band = atoi(*argv++);
+        }
         else if (strcmp(cmd, "-h") == 0 || strcmp(cmd, "--help") == 0)
         {
             return false;
@@ -156,6 +216,9 @@ typedef struct {
     uint16_t height;
     uint16_t y;
     const struct mf_font_s *font;
+    struct mf_framebuffer_s fb;
+    struct mf_framebuffer_s pages;
+    struct mf_band_layout_s layout;
 } state_t;
 
 /* Callback to write to a memory buffer. */
@@ -181,11 +244,64 @@ static void pixel_callback(int16_t x, int16_t y, uint8_t count, uint8_t alpha,
     }
 }
 
+/* Callback to write a row of pixels to a memory buffer. */
+static void row_callback(int16_t y, const struct mf_span_s *spans,
+                         uint8_t count, void *state)
+{
+    while (count--)
+    {
+        pixel_callback(spans->x, y, spans->count, spans->alpha, state);
+        spans++;
+    }
+}
+
+/* Callback to write a bit mask of black & white pixels. */
+static void mask_callback(int16_t x, int16_t y, uint32_t mask, void *state)
+{
+    for (; mask; mask <<= 1, x++)
+    {
+        if (mask & 0x80000000UL)
+            pixel_callback(x, y, 1, 255, state);
+    }
+}
+
 /* Callback to render characters. */
 static uint8_t character_callback(int16_t x, int16_t y, mf_char character,
                                   void *state)
 {
     state_t *s = (state_t*)state;
+
+    if (s->options->band > 0)
+    {
+        return mf_band_add_character(x, y, character, &s->layout);
+    }
+    else if (s->options->pages)
+    {
+        return mf_framebuffer_render_character(&s->pages, s->font,
+                                               x, y, character);
+    }
+    else if (s->options->direct)
+    {
+        return mf_framebuffer_render_character(&s->fb, s->font,
+                                               x, y, character);
+    }
+    else if (s->options->masks)
+    {
+        return mf_render_character_masks(s->font, x, y, character, 8,
+                                         mask_callback, state);
+    }
+    else if (s->options->rows)
+    {
+        return mf_render_character_rows(s->font, x, y, character,
+                                        row_callback, state);
+    }
+    else if (s->options->clipped)
+    {
+        return mf_render_character_clipped(s->font, x, y, character,
+                                           &s->options->clip,
+                                           pixel_callback, state);
+    }
+
     return mf_render_character(s->font, x, y, character, pixel_callback, state);
 }
 
@@ -194,7 +310,20 @@ static bool line_callback(const char *line, uint16_t count, void *state)
 {
     state_t *s = (state_t*)state;
 
-    if (s->options->justify)
+    if (s->options->clipped && s->options->justify)
+    {
+        mf_render_justified_clipped(s->font, s->options->anchor, s->y,
+                                    s->width - s->options->margin * 2,
+                                    line, count, &s->options->clip,
+                                    character_callback, state);
+    }
+    else if (s->options->clipped)
+    {
+        mf_render_aligned_clipped(s->font, s->options->anchor, s->y,
+                                  s->options->alignment, line, count,
+                                  &s->options->clip, character_callback, state);
+    }
+    else if (s->options->justify)
     {
         mf_render_justified(s->font, s->options->anchor, s->y,
                             s->width - s->options->margin * 2,
@@ -210,6 +339,28 @@ static bool line_callback(const char *line, uint16_t count, void *state)
     return true;
 }
 
+/* List the different characters of the text in increasing order, for
+ * decoding them to RAM. Returns the number of characters. */
+static uint16_t list_characters(mf_str text, mf_char *chars)
+{
+    static uint8_t seen[65536 / 8];
+    uint16_t c, count;
+    uint32_t i;
+
+    memset(seen, 0, sizeof(seen));
+    while ((c = (uint16_t)mf_getchar(&text)) != 0)
+        seen[c >> 3] |= 1 << (c & 7);
+
+    count = 0;
+    for (i = 0; i < 65536; i++)
+    {
+        if (seen[i >> 3] & (1 << (i & 7)))
+            chars[count++] = i;
+    }
+
+    return count;
+}
+
 /* Callback to just count the lines.
  * Used to decide the image height */
 bool count_lines(const char *line, uint16_t count, void *state)
@@ -222,8 +373,11 @@ bool count_lines(const char *line, uint16_t count, void *state)
 int main(int argc, const char **argv)
 {
     int height;
+    void *cache = NULL;
+    void *ram = NULL;
     const struct mf_font_s *font;
     struct mf_scaledfont_s scaledfont;
+    struct mf_ramfont_s ramfont;
     options_t options;
     state_t state = {};
 
@@ -245,7 +399,8 @@ int main(int argc, const char **argv)
         fclose(f);
 
         font = mf_make_font(bulk, fsize);
-        printf("Font loaded, name %s\n", font->full_name);
+        if (font)
+            printf("Font loaded, name %s\n", font->full_name);
     }
     else
     {
@@ -258,6 +413,17 @@ int main(int argc, const char **argv)
         return 2;
     }
 
+    if (options.ramsize > 0)
+    {
+        mf_char *chars = malloc(strlen(options.text) * sizeof(mf_char));
+        uint16_t count = list_characters(options.text, chars);
+
+        ram = malloc(options.ramsize);
+        mf_transcode_font(&ramfont, font, chars, count, ram, options.ramsize);
+        font = &ramfont.font;
+        free(chars);
+    }
+
     if (options.scale > 1)
     {
         mf_scale_font(&scaledfont, font, options.scale, options.scale);
@@ -282,9 +448,92 @@ int main(int argc, const char **argv)
     /* Initialize image to white */
     memset(state.buffer, 255, options.width * height);
 
+    /* Description of the buffer for rendering to it directly */
+    state.fb.pixels = state.buffer;
+    state.fb.stride = state.width;
+    state.fb.format = MF_PIXEL_FORMAT_8BPP;
+    state.fb.color = 0;
+    state.fb.clip_x0 = 0;
+    state.fb.clip_y0 = 0;
+    state.fb.clip_x1 = state.width;
+    state.fb.clip_y1 = state.height;
+
+    /* Buffer in the format of monochrome displays with 8 pixel pages */
+    state.pages = state.fb;
+    state.pages.pixels = calloc(options.width, (height + 7) / 8);
+    state.pages.format = MF_PIXEL_FORMAT_1BPP_PAGES;
+    state.pages.color = 1;
+
+#if MF_USE_GLYPH_CACHE
+    if (options.cachesize > 0)
+    {
+        cache = malloc(options.cachesize);
+        mf_glyphcache_init(cache, options.cachesize);
+    }
+#endif
+
     /* Render the text */
-    mf_wordwrap(font, options.width - 2 * options.margin,
-                options.text, line_callback, &state);
+    if (options.band > 0)
+    {
+        /* Lay out the text once, then render it a band at a time into a
+         * separate buffer that is copied to the image. */
+        int y, rows;
+        struct mf_band_glyph_s *glyphs;
+        uint16_t capacity = strlen(options.text);
+        state_t band = state;
+
+        glyphs = malloc(capacity * sizeof(struct mf_band_glyph_s));
+        mf_band_init(&state.layout, font, glyphs, capacity);
+        mf_wordwrap(font, options.width - 2 * options.margin,
+                    options.text, line_callback, &state);
+
+        band.height = options.band;
+        band.buffer = malloc(options.width * options.band);
+
+        for (y = 0; y < height; y += options.band)
+        {
+            memset(band.buffer, 255, options.width * options.band);
+            mf_band_render(&state.layout, y, y + options.band,
+                           pixel_callback, &band);
+
+            rows = (height - y < options.band) ? height - y : options.band;
+            memcpy(state.buffer + options.width * y, band.buffer,
+                   options.width * rows);
+        }
+
+        free(band.buffer);
+        free(glyphs);
+    }
+    else
+    {
+        mf_wordwrap(font, options.width - 2 * options.margin,
+                    options.text, line_callback, &state);
+    }
+
+#if MF_USE_GLYPH_CACHE
+    if (cache)
+    {
+        uint32_t hits, misses;
+        mf_glyphcache_get_stats(&hits, &misses);
+        mf_glyphcache_init(NULL, 0);
+        printf("Glyph cache: %lu hits, %lu misses\n",
+               (unsigned long)hits, (unsigned long)misses);
+    }
+#endif
+
+    /* Copy the pages to the image */
+    if (options.pages)
+    {
+        int x, y;
+        for (y = 0; y < height; y++)
+        {
+            for (x = 0; x < options.width; x++)
+            {
+                if (state.pages.pixels[(y / 8) * options.width + x] & (1 << (y % 8)))
+                    state.buffer[y * options.width + x] = 0;
+            }
+        }
+    }
 
     /* Write out the bitmap */
     write_bmp(options.filename, state.buffer, state.width, state.height);
@@ -292,6 +541,9 @@ int main(int argc, const char **argv)
     printf("Wrote %s\n", options.filename);
 
     free(state.buffer);
+    free(state.pages.pixels);
+    free(cache);
+    free(ram);
     return 0;
 }
 